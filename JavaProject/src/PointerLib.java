@@ -0,0 +1,67 @@
+import java.nio.ByteBuffer;
+
+/**
+ * Java bindings for pointerLib (pointerJNI.cpp). The camera runs on a native thread; events arrive in
+ * primitive arrays the caller reuses and frames in direct ByteBuffers over native buffers, so nothing is
+ * allocated on the Java heap per frame.
+ */
+public class PointerLib {
+    static {
+        System.loadLibrary("pointerJNI");
+    }
+
+    public static final int EVENT_HAND_ENTER = 0;
+    public static final int EVENT_HAND_MOVE = 1;
+    public static final int EVENT_HAND_LEAVE = 2;
+    public static final int EVENT_GESTURE = 3;
+
+    public static final int GESTURE_SWIPE_LEFT = 0;
+    public static final int GESTURE_SWIPE_RIGHT = 1;
+    public static final int GESTURE_SWIPE_UP = 2;
+    public static final int GESTURE_SWIPE_DOWN = 3;
+    public static final int GESTURE_CIRCLE_CW = 4;
+    public static final int GESTURE_CIRCLE_CCW = 5;
+    public static final int GESTURE_PUSH = 6;
+    public static final int GESTURE_PULL = 7;
+
+    /** Per event in drainEvents: ints holds type, sequence, hand, gesture; floats holds px, py, x, y, z, distance. */
+    public static final int INT_STRIDE = 4;
+    public static final int FLOAT_STRIDE = 6;
+
+    public static final int FILTER_NONE = 0;
+    public static final int FILTER_ONE_EURO = 1;
+    public static final int FILTER_KALMAN = 2;
+
+    /** Opens the camera and allocates the frame buffers. Later calls return true without doing either again. */
+    public static native boolean init();
+    public static native boolean start();
+    public static native void stop();
+    public static native void setFilter(int mode, float a, float b);
+
+    /** Sleeps until an event is queued or timeoutMs passes; returns whether one is queued. */
+    public static native boolean waitEvents(int timeoutMs);
+    /** Drains as many events as the arrays have room for; times gets the capture time in ms. Returns the count. */
+    public static native int drainEvents(int[] ints, float[] floats, double[] times);
+
+    /**
+     * The frame buffers, fixed for the life of the process: depth holds z16 pixels and color
+     * BufferedImage.TYPE_INT_RGB pixels, both in little-endian order. Fetch them once.
+     */
+    public static native ByteBuffer[] depthBuffers();
+    public static native ByteBuffer[] colorBuffers();
+
+    /**
+     * Index into the buffer array of the newest frame, or -1 if there is none since the last call. The buffer
+     * is not written until it is released or another frame is acquired.
+     */
+    public static native int acquireDepth();
+    public static native void releaseDepth();
+    public static native int acquireColor();
+    public static native void releaseColor();
+
+    /** Frame sizes. init() keeps the camera in the mode it opens in, so these hold for every frame. */
+    public static native int depthWidth();
+    public static native int depthHeight();
+    public static native int colorWidth();
+    public static native int colorHeight();
+}
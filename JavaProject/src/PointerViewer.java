@@ -0,0 +1,150 @@
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.IntBuffer;
+import java.nio.ShortBuffer;
+import javax.swing.*;
+import java.awt.Graphics;
+import java.awt.Transparency;
+import java.awt.color.ColorSpace;
+import java.awt.image.*;
+
+// Shows the color and depth streams and prints pointer events through PointerLib. Every buffer is created
+// before the loop, so a running viewer makes no garbage, and the frames are drawn straight from PointerLib's
+// direct buffers without being copied into a Java raster first.
+public class PointerViewer
+{
+    public static void main(String s[])
+    {
+        if (!PointerLib.init())
+        {
+            System.out.println("No camera found");
+            System.exit(3);
+        }
+
+        int cWidth = PointerLib.colorWidth(), cHeight = PointerLib.colorHeight();
+        int dWidth = PointerLib.depthWidth(), dHeight = PointerLib.depthHeight();
+
+        ByteBuffer[] colorBytes = PointerLib.colorBuffers(), depthBytes = PointerLib.depthBuffers();
+        IntBuffer[] color = new IntBuffer[colorBytes.length];
+        for (int i = 0; i < color.length; i++)
+            color[i] = colorBytes[i].order(ByteOrder.LITTLE_ENDIAN).asIntBuffer();
+        ShortBuffer[] depth = new ShortBuffer[depthBytes.length];
+        for (int i = 0; i < depth.length; i++)
+            depth[i] = depthBytes[i].order(ByteOrder.LITTLE_ENDIAN).asShortBuffer();
+
+        // one image per native slot, drawn while the slot is held
+        BufferedImage[] colorImages = new BufferedImage[color.length];
+        DirectColorModel rgb = new DirectColorModel(24, 0xff0000, 0x00ff00, 0x0000ff);
+        for (int i = 0; i < color.length; i++)
+            colorImages[i] = new BufferedImage(rgb, Raster.createWritableRaster(rgb.createCompatibleSampleModel(cWidth, cHeight),
+                new DirectDataBuffer(color[i], null, cWidth * cHeight), null), false, null);
+        BufferedImage[] depthImages = new BufferedImage[depth.length];
+        ComponentColorModel gray = new ComponentColorModel(ColorSpace.getInstance(ColorSpace.CS_GRAY), false, false,
+            Transparency.OPAQUE, DataBuffer.TYPE_BYTE);
+        for (int i = 0; i < depth.length; i++)
+            depthImages[i] = new BufferedImage(gray, Raster.createWritableRaster(gray.createCompatibleSampleModel(dWidth, dHeight),
+                new DirectDataBuffer(null, depth[i], dWidth * dHeight), null), false, null);
+
+        Listener listener = new Listener();
+
+        final FrameView c_df = new FrameView();
+        JFrame cframe = new JFrame("pointerLib - Color Stream");
+        cframe.addWindowListener(listener);
+        cframe.setSize(cWidth, cHeight);
+        cframe.add(c_df);
+        cframe.setVisible(true);
+
+        final FrameView d_df = new FrameView();
+        JFrame dframe = new JFrame("pointerLib - Depth Stream");
+        dframe.addWindowListener(listener);
+        dframe.setSize(dWidth, dHeight);
+        dframe.add(d_df);
+        dframe.setVisible(true);
+
+        int max = 64;
+        int[] ints = new int[max * PointerLib.INT_STRIDE];
+        float[] floats = new float[max * PointerLib.FLOAT_STRIDE];
+        double[] times = new double[max];
+
+        // the native slot may be rewritten as soon as it is released, so the frame is painted before that
+        Runnable paintColor = new Runnable() { public void run() { c_df.paintImmediately(0, 0, c_df.getWidth(), c_df.getHeight()); } };
+        Runnable paintDepth = new Runnable() { public void run() { d_df.paintImmediately(0, 0, d_df.getWidth(), d_df.getHeight()); } };
+
+        PointerLib.start();
+        while (listener.exit == false)
+        {
+            if (PointerLib.waitEvents(15))
+            {
+                int n = PointerLib.drainEvents(ints, floats, times);
+                for (int e = 0; e < n; e++)
+                {
+                    int type = ints[e * PointerLib.INT_STRIDE];
+                    if (type == PointerLib.EVENT_HAND_MOVE) continue;
+                    System.out.println("event " + type + " gesture " + ints[e * PointerLib.INT_STRIDE + 3]
+                        + " at " + floats[e * PointerLib.FLOAT_STRIDE] + ", " + floats[e * PointerLib.FLOAT_STRIDE + 1]);
+                }
+            }
+
+            int slot = PointerLib.acquireColor();
+            if (slot >= 0)
+            {
+                c_df.image = colorImages[slot];
+                paint(paintColor);
+                PointerLib.releaseColor();
+            }
+
+            slot = PointerLib.acquireDepth();
+            if (slot >= 0)
+            {
+                d_df.image = depthImages[slot];
+                paint(paintDepth);
+                PointerLib.releaseDepth();
+            }
+        }
+        PointerLib.stop();
+
+        cframe.dispose();
+        dframe.dispose();
+    }
+
+    static void paint(Runnable painter)
+    {
+        try { SwingUtilities.invokeAndWait(painter); }
+        catch (Exception e) { }
+    }
+}
+
+// Draws whichever slot's image it was last given.
+class FrameView extends JComponent
+{
+    public BufferedImage image;
+
+    @Override protected void paintComponent(Graphics g)
+    {
+        if (image != null) g.drawImage(image, 0, 0, null);
+    }
+}
+
+// Read-only pixels over a native frame, in place: packed RGB from an IntBuffer, or 8-bit gray from a z16
+// ShortBuffer, near bright and no data black, computed as the pixel is read.
+class DirectDataBuffer extends DataBuffer
+{
+    private final IntBuffer rgb;
+    private final ShortBuffer depth;
+
+    public DirectDataBuffer(IntBuffer rgb, ShortBuffer depth, int size)
+    {
+        super(rgb != null ? DataBuffer.TYPE_INT : DataBuffer.TYPE_BYTE, size);
+        this.rgb = rgb;
+        this.depth = depth;
+    }
+
+    @Override public int getElem(int bank, int i)
+    {
+        if (rgb != null) return rgb.get(i);
+        int v = 255 - Math.min(255, (depth.get(i) & 0xffff) >> 3);
+        return v == 255 ? 0 : v;
+    }
+
+    @Override public void setElem(int bank, int i, int value) { }
+}
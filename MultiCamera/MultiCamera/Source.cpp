@@ -10,12 +10,52 @@
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <cstdio>
+#include <ctime>
 #include <iostream>
+#include <thread>
+#include "decimation.hpp"
+#include "temporal_filter.hpp"
+#include "fusion.hpp"
+#include "registration.hpp"
+#include "voxel_grid.hpp"
+#include "frame_sync.hpp"
+#include "laser_scheduler.hpp"
+#include "cloud_exporter.hpp"
+#include "bitmask.hpp"
+#include "click_zones.hpp"
+#include "motion_gate.hpp"
+#include "device_manager.hpp"
+#include "lens.hpp"
+#include "depth_range.hpp"
+#include "background_model.hpp"
+#include "trace.hpp"
 
 // Also include GLFW to allow for graphical display
 #define GLFW_INCLUDE_GLU
 #include <GLFW/glfw3.h>
 
+const int MAX_CAMERAS = 4;
+
+// Resolution each consumer works at, as a decimation factor of the depth stream
+const int CLICK_DECIMATION = 2;
+const int RENDER_DECIMATION = 1;
+
+// The click heuristic counts occupied cells of this size in the near box, so it does not scale with sensor resolution
+const float CLICK_VOXEL_SIZE = 0.01f;
+const rs::float3 NEAR_BOX_MIN = { -10, -10, 0 }, NEAR_BOX_MAX = { 10, 10, .5f };
+const int PRESENCE_VOXELS = 70;
+
+// Largest frame-to-frame step the temporal filter still smooths, converted to each camera's raw units
+const float TEMPORAL_DELTA_M = 0.02f;
+
+// Virtual buttons: the panel's x/y extent in camera space split into a grid, each button a slab of the near range
+const rs::float3 BUTTON_PANEL_MIN = { -.3f, -.2f, .3f }, BUTTON_PANEL_MAX = { .3f, .2f, .5f };
+const int BUTTON_COLUMNS = 3, BUTTON_ROWS = 2;
+
+// Each camera's stream mode follows how long runCamera takes on it; an idle camera drops to 30 fps at most
+const float STREAM_BUDGET_MS = 12;
+const int IDLE_FRAMES = 120;
+
 double yaw, pitch, lastX, lastY; int ml;
 static void on_mouse_button(GLFWwindow * win, int button, int action, int mods)
 {
@@ -33,9 +73,16 @@ static void on_cursor_pos(GLFWwindow * win, double x, double y)
 	lastY = y;
 }
 
-int runWindow(GLFWwindow * win, const uint16_t * depth_image, const uint8_t * color_image,
-	rs::intrinsics depth_intrin, rs::extrinsics depth_to_color, rs::intrinsics color_intrin, float scale) {
+// R starts and stops recording the merged cloud to disk, T writes the pipeline trace (MR_ENABLE_TRACE builds)
+bool recordToggled, traceRequested;
+static void on_key(GLFWwindow * win, int key, int scancode, int action, int mods)
+{
+	if (key == GLFW_KEY_R && action == GLFW_PRESS) recordToggled = true;
+	if (key == GLFW_KEY_T && action == GLFW_PRESS) traceRequested = true;
+}
 
+int runWindow(GLFWwindow * win, const cloud_fusion & cloud) {
+	MR_TRACE_SCOPE("runWindow");
 
 	// Set up a perspective transform in a space that we can rotate by clicking and dragging the mouse
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -50,133 +97,130 @@ int runWindow(GLFWwindow * win, const uint16_t * depth_image, const uint8_t * co
 	glRotated(yaw, 0, 1, 0);
 	glTranslatef(0, 0, -0.5f);
 
-	// We will render our depth data as a set of points in 3D space
+	// We will render the merged cloud of every camera as a set of points in world space,
+	// straight from the fusion buffers instead of one glVertex call per point
 	glPointSize(2);
 	glEnable(GL_DEPTH_TEST);
-	glBegin(GL_POINTS);
-
-	for (int dy = 0; dy<depth_intrin.height; ++dy)
-	{
-		for (int dx = 0; dx<depth_intrin.width; ++dx)
-		{
-			// Retrieve the 16-bit depth value and map it into a depth in meters
-			uint16_t depth_value = depth_image[dy * depth_intrin.width + dx];
-			float depth_in_meters = depth_value * scale;
-
-			// Skip over pixels with a depth value of zero, which is used to indicate no data
-			if (depth_value == 0) continue;
-
-			// Map from pixel coordinates in the depth image to pixel coordinates in the color image
-			rs::float2 depth_pixel = { (float)dx, (float)dy };
-			rs::float3 depth_point = depth_intrin.deproject(depth_pixel, depth_in_meters);
-			rs::float3 color_point = depth_to_color.transform(depth_point);
-			rs::float2 color_pixel = color_intrin.project(color_point);
-
-			// Use the color from the nearest color pixel, or pure white if this point falls outside the color image
-			const int cx = (int)std::round(color_pixel.x), cy = (int)std::round(color_pixel.y);
-			if (cx < 0 || cy < 0 || cx >= color_intrin.width || cy >= color_intrin.height)
-			{
-				glColor3ub(255, 255, 255);
-			}
-			else
-			{
-				glColor3ubv(color_image + (cy * color_intrin.width + cx) * 3);
-			}
-
-			// Emit a vertex at the 3D location of this depth pixel
-			glVertex3f(depth_point.x, depth_point.y, depth_point.z);
-		}
-	}
-	glEnd();
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, 0, cloud.get_points());
+	glColorPointer(3, GL_UNSIGNED_BYTE, 0, cloud.get_colors());
+	glDrawArrays(GL_POINTS, 0, (GLsizei)cloud.size());
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
 
 	glfwSwapBuffers(win);
 
 	return 0;
 }
 
-bool runCamera(rs::device * camera, GLFWwindow * win, int cameraID) {
+// processed is false when the frame was skipped without doing the detection work
+bool runCamera(device_frame & frame, cloud_fusion & cloud, int cameraID, bool & processed) {
+	MR_TRACE_SCOPE_ID("runCamera", cameraID);
 	//camera->enable_stream(rs::stream::depth, rs::preset::best_quality);
-	camera->wait_for_frames();
-	int32_t numpoints = 0;
-
-	const int STACK_SIZE = 10;
-	static int32_t prevPtsStack[STACK_SIZE] = {};
-	static int32_t * stackHead = prevPtsStack;
-	static int iterationCtr = 0;
-
-	// Retrieve our images
-	const uint16_t * depth_image = (const uint16_t *)camera->get_frame_data(rs::stream::depth);
-	const uint8_t * color_image = (const uint8_t *)camera->get_frame_data(rs::stream::color);
-
-
-	// Retrieve camera parameters for mapping between depth and color
-	rs::intrinsics depth_intrin = camera->get_stream_intrinsics(rs::stream::depth);
-	rs::extrinsics depth_to_color = camera->get_extrinsics(rs::stream::depth, rs::stream::color);
-	rs::intrinsics color_intrin = camera->get_stream_intrinsics(rs::stream::color);
-	float scale = camera->get_depth_scale();
-	float maxX = 0, maxY = 0, maxZ = 0;
-	for (int dy = 0; dy < depth_intrin.height; dy += 2)
+	int32_t numvoxels = 0;
+	static int iterationCtr[MAX_CAMERAS] = {};
+	processed = false;
+
+	// Retrieve our images, already copied out of the device by the capture thread
+	uint16_t * depth_image = frame.depth.data();
+	const uint8_t * color_image = frame.color.data();
+
+
+	// Camera parameters for mapping between depth and color, as they were when the frame was captured; the
+	// device itself may be restarting on its capture thread
+	const rs::intrinsics & depth_intrin = frame.depth_intrin;
+	const rs::extrinsics & depth_to_color = frame.depth_to_color;
+	const rs::intrinsics & color_intrin = frame.color_intrin;
+	const float scale = frame.depth_scale;
+
+	// With nobody in front of the camera a frame like the last one gives the same answer, so skip the work. Only
+	// while idle: a present camera must add its points to every frame's cloud.
+	static motion_gate motionGates[MAX_CAMERAS];
+	static bool present[MAX_CAMERAS];
+	motion_gate & motionGate = motionGates[cameraID];
+	motionGate.configure(scale);
+	if (!present[cameraID] && !motionGate.should_process(depth_image, depth_intrin.width, depth_intrin.height)) return false;
+	present[cameraID] = false;
+	processed = true;
+
+	// Stabilise the frame in place before anything reads it, so single-frame holes and spikes don't flip the near-point count
+	static temporal_filter depthFilters[MAX_CAMERAS];
+	depthFilters[cameraID].set_delta(meters_to_raw(TEMPORAL_DELTA_M, scale));
+	depthFilters[cameraID].process(depth_image, depth_intrin.width, depth_intrin.height);
+
+	// The click heuristic only needs a coarse cloud, so bin the frame down rather than skipping pixels
+	static depth_decimator clickDecimators[MAX_CAMERAS];
+	depth_decimator & clickDecimator = clickDecimators[cameraID];
+	clickDecimator.set_factor(CLICK_DECIMATION);
+	const uint16_t * click_image = clickDecimator.process(depth_image, depth_intrin);
+	const rs::intrinsics & click_intrin = clickDecimator.get_intrinsics();
+
+	// Each button keeps its own baseline, so motion elsewhere in view no longer reads as a click
+	static click_detector clickDetectors[MAX_CAMERAS];
+	click_detector & clickDetector = clickDetectors[cameraID];
+	if (clickDetector.zone_count() == 0) clickDetector.add_grid(BUTTON_PANEL_MIN, BUTTON_PANEL_MAX, BUTTON_COLUMNS, BUTTON_ROWS);
+	for (const click_event & e : clickDetector.process(click_image, click_intrin, scale))
 	{
-		for (int dx = 0; dx < depth_intrin.width; dx += 2)
-		{
-			// Retrieve the 16-bit depth value and map it into a depth in meters
-			uint16_t depth_value = depth_image[dy * depth_intrin.width + dx];
-			float depth_in_meters = depth_value * scale;
-
-			// Skip over pixels with a depth value of zero, which is used to indicate no data
-			if (depth_value == 0) continue;
-
-			rs::float2 depth_pixel = { (float)dx, (float)dy };
-			rs::float3 depth_point = depth_intrin.deproject(depth_pixel, depth_in_meters);
-
-			rs::float3 color_point = depth_to_color.transform(depth_point);
-			rs::float2 color_pixel = color_intrin.project(color_point);
-
-			// Use the color from the nearest color pixel, or pure white if this point falls outside the color image
-			const int cx = (int)std::round(color_pixel.x), cy = (int)std::round(color_pixel.y);
-
-			// Check for green to get some kind of helpful data
-
-			float x = depth_point.x;
-			float y = depth_point.y;
-			float z = depth_point.z;
-			
-
-			if (z < .5)
-				numpoints++;
-
-			//setup maxes
-			if (maxX < x)
-				maxX = x;
-			if (maxY < y)
-				maxY = y;
-			if (maxZ < z)
-				maxZ = z;
-
-			//printf("x: %.2f, y: %.2f, z: %.2f | ", x, y, z);
-		}
-		//printf("\n");
+		if (e.kind == click_kind::primary) printf("\n   *** PRIMARY CLICK ON BUTTON %d @ %d (%d px, baseline %.0f) *** \n\n", e.zone, iterationCtr[cameraID], e.count, e.baseline);
+		if (e.kind == click_kind::secondary) printf("\n   *** SECONDARY CLICK ON BUTTON %d @ %d (%d px, baseline %.0f) *** \n\n", e.zone, iterationCtr[cameraID], e.count, e.baseline);
 	}
-	//printf("Camera %d - max x: %.2f, max y: %.2f, max z: %.2f \n", number, maxX, maxY, maxZ);
-	//printf("Camera %d - number points  %d\n", number, numpoints);
-
-	if (numpoints > 2500)
+	iterationCtr[cameraID]++;
+
+	// Only points inside the near box can count towards presence, so find them with a 1-bit range mask first.
+	// Each near pixel adds at most one voxel: with no more near pixels than PRESENCE_VOXELS the frame cannot pass.
+	static bitmask nearMasks[MAX_CAMERAS];
+	static depth_range nearRanges[MAX_CAMERAS];
+	bitmask & nearMask = nearMasks[cameraID];
+	depth_range & nearRange = nearRanges[cameraID];
+	nearRange.set_meters(0, NEAR_BOX_MAX.z);
+	nearRange.configure(scale);
+	nearMask.from_depth_range(click_image, click_intrin.width, click_intrin.height, nearRange.get_lo(), nearRange.get_hi());
+	if (nearMask.count() <= (size_t)PRESENCE_VOXELS) return false;
+
+	static voxel_grid clickGrids[MAX_CAMERAS];
+	voxel_grid & clickGrid = clickGrids[cameraID];
+	if (clickGrid.get_cell_size() != CLICK_VOXEL_SIZE) clickGrid.set_cell_size(CLICK_VOXEL_SIZE);
+	clickGrid.clear();
+
+	// Far points could only land in voxels outside the box, so deproject the near ones alone, in one batch
+	// with the kernel for this stream's distortion model
+	static std::vector<float> nearU[MAX_CAMERAS], nearV[MAX_CAMERAS], nearZ[MAX_CAMERAS], nearX[MAX_CAMERAS], nearY[MAX_CAMERAS];
+	std::vector<float> & u = nearU[cameraID], & v = nearV[cameraID], & z = nearZ[cameraID], & x = nearX[cameraID], & y = nearY[cameraID];
+	u.clear();
+	v.clear();
+	z.clear();
+	nearMask.for_each([&](int dx, int dy)
 	{
-		prevPtsStack[iterationCtr % STACK_SIZE] = numpoints;
-		stackHead = &prevPtsStack[iterationCtr % STACK_SIZE];
-
-		int avg, sum = 0;
-		for (int i = 0; i < STACK_SIZE; i++) sum += prevPtsStack[i];
-		avg = sum / STACK_SIZE;
-
-		printf("Camera %d - number points  %d, prev pts %d, recent ctr %d, sum %d, avg %d, diff %d\n", 
-			cameraID, numpoints, *stackHead, iterationCtr, sum, avg, numpoints - avg);
-		runWindow(win, depth_image, color_image, depth_intrin, depth_to_color, color_intrin, scale);
-
-		if (numpoints > avg + 2000) printf("\n   *** PRIMARY CLICK GESTURE DETECTED @ %d *** \n\n", iterationCtr);
-		if (numpoints < avg - 1250) printf("\n   *** SECONDARY CLICK GESTURE DETECTED @ %d *** \n\n", iterationCtr);
-		
-		iterationCtr++;
+		u.push_back((float)dx);
+		v.push_back((float)dy);
+		z.push_back(click_image[dy * click_intrin.width + dx] * scale);
+	});
+	x.resize(u.size());
+	y.resize(u.size());
+	get_lens_kernels(click_intrin.model()).deproject_n(click_intrin, u.data(), v.data(), z.data(), u.size(), x.data(), y.data());
+	for (size_t i = 0; i < u.size(); i++) clickGrid.insert({ x[i], y[i], z[i] });
+
+	numvoxels = clickGrid.voxels_in_box(NEAR_BOX_MIN, NEAR_BOX_MAX);
+	if (numvoxels > PRESENCE_VOXELS)
+	{
+		printf("Camera %d - near voxels  %d\n", cameraID, numvoxels);
+
+		MR_TRACE_SCOPE_ID("render cloud", cameraID);
+		static depth_decimator renderDecimators[MAX_CAMERAS];
+		depth_decimator & renderDecimator = renderDecimators[cameraID];
+		renderDecimator.set_factor(RENDER_DECIMATION);
+		const uint16_t * render_image = renderDecimator.process(depth_image, depth_intrin);
+
+		// Map the render frame into the color image once; the cloud colors come from this map. The cameras are
+		// processed in turn here, so their registrations share one row pool
+		static registration registrations[MAX_CAMERAS];
+		registration & reg = registrations[cameraID];
+		reg.configure(renderDecimator.get_intrinsics(), color_intrin, depth_to_color, scale);
+		reg.process(render_image, color_image);
+		cloud.add_camera_frame(cameraID, render_image, renderDecimator.get_intrinsics(), scale, color_image, reg.get_color_index());
+
+		present[cameraID] = true;
 		return true;
 	}
 
@@ -188,6 +232,9 @@ bool runCamera(rs::device * camera, GLFWwindow * win, int cameraID) {
 
 int main() try
 {
+	MR_TRACE_THREAD("render");
+	MR_TRACE_DUMP_AT_EXIT("trace.json");
+
 	// Turn on logging. We can separately enable logging to console or to file, and use different severity filters for each.
 	rs::log_to_console(rs::log_severity::warn);
 	//rs::log_to_file(rs::log_severity::debug, "librealsense.log");
@@ -197,26 +244,105 @@ int main() try
 	printf("There are %d connected RealSense devices.\n", ctx.get_device_count());
 	if (ctx.get_device_count() == 0) return EXIT_FAILURE;
 
-	// This tutorial will access only a single device, but it is trivial to extend to multiple devices
-	rs::device * dev = ctx.get_device(0);
-	rs::device * dev2 = ctx.get_device(1);
-	printf("\nUsing device 0, an %s\n", dev->get_name());
-	printf("    Serial number: %s\n", dev->get_serial());
-	printf("    Firmware version: %s\n", dev->get_firmware_version());
+	// Start every camera at once, each in the best mode its controller allows; an idle camera drops to 30 fps
+	device_manager devices;
+	const int streaming = devices.open(ctx, rs::format::rgb8, [](int, stream_controller & controller)
+	{
+		const stream_profile idle = { 0, 0, 0, 30 }, active = { 0, 0, 0, 0 };
+		controller.set_profiles(idle, active);
+		controller.set_budget(STREAM_BUDGET_MS);
+	}, MAX_CAMERAS);
+	std::vector<rs::device *> cameras;
+	for (int i = 0; i < devices.get_device_count(); i++)
+	{
+		const device_info & info = devices.get_info(i);
+		cameras.push_back(devices.get_device(i));
+		printf("\nUsing device %d, an %s\n", i, cameras[i]->get_name());
+		printf("    Serial number: %s\n", cameras[i]->get_serial());
+		printf("    Firmware version: %s\n", info.firmware.empty() ? "unknown" : info.firmware.c_str());
+		if (!devices.is_streaming(i)) printf("    Failed to start, retrying in the background\n");
+	}
+	printf("%d of %d cameras streaming\n", streaming, (int)cameras.size());
+#ifdef MR_BENCHMARK
+	for (int i = 0; i < (int)cameras.size(); i++)
+	{
+		if (!devices.is_streaming(i)) continue;
+		lens_benchmark(cameras[i]->get_stream_intrinsics(rs::stream::depth));
+		lens_benchmark(cameras[i]->get_stream_intrinsics(rs::stream::color));
+		background_benchmark(cameras[i]->get_stream_width(rs::stream::depth), cameras[i]->get_stream_height(rs::stream::depth));
+	}
+#endif
 
-	// Configure depth and color to run with the device's preferred settings
-	dev->enable_stream(rs::stream::depth, rs::preset::best_quality);
-	dev->enable_stream(rs::stream::color, rs::preset::best_quality);
-	dev->start();
+	// Place every camera in the shared world frame; cameras missing from the pose file stay at the origin
+	cloud_fusion fusion;
+	fusion.set_camera_count((int)cameras.size());
+	for (int i = 0; i < fusion.get_camera_count(); i++)
+	{
+		rs::extrinsics pose = identity_pose();
+		if (!load_camera_pose("camera_poses.txt", cameras[i]->get_serial(), pose))
+			printf("No pose for camera %d (%s) in camera_poses.txt, using identity\n", i, cameras[i]->get_serial());
+		fusion.set_pose(i, pose);
+	}
 
-	if (ctx.get_device_count() > 1)
+	// Each camera gets its own capture thread; the render loop below only ever sees time-aligned sets of frames
+	frame_synchronizer sync((int)cameras.size());
+	// Overlapping cameras blind each other, so only one projector is on at a time
+	laser_scheduler lasers;
+	for (auto camera : cameras) lasers.add_device(camera);
+	lasers.start(sync.now());
+
+	std::atomic<bool> capturing(true);
+	std::vector<std::thread> captureThreads;
+	// Stops and joins the capture threads however main is left, so an rs::error out of the render loop reaches
+	// the handler below instead of destroying joinable threads
+	struct capture_stopper
+	{
+		std::atomic<bool> & capturing;
+		std::vector<std::thread> & threads;
+		~capture_stopper()
+		{
+			capturing = false;
+			for (auto & t : threads) if (t.joinable()) t.join();
+		}
+	} stopCapture = { capturing, captureThreads };
+	for (int i = 0; i < (int)cameras.size(); i++)
 	{
-		dev2 = ctx.get_device(1);
-		// Configure depth and color to run with the device's preferred settings
-		dev2->enable_stream(rs::stream::depth, rs::preset::best_quality);
-		dev2->enable_stream(rs::stream::color, rs::preset::best_quality);
-		dev2->start();
-		dev2->set_option(rs::option::f200_laser_power, 0);
+		captureThreads.emplace_back([&, i]()
+		{
+			MR_TRACE_THREAD_ID("capture", i);
+			// A camera that drops out is restarted by next_frame while the others keep going
+			bool wasStreaming = devices.is_streaming(i);
+			while (capturing)
+			{
+				bool restarted;
+				bool ready;
+				{
+					MR_TRACE_SCOPE_ID("wait_for_frames", i);
+					ready = devices.next_frame(i, 100, &restarted);
+				}
+				if (devices.is_streaming(i) != wasStreaming)
+				{
+					wasStreaming = !wasStreaming;
+					printf(wasStreaming ? "Camera %d is back\n" : "Camera %d stopped delivering frames, restarting it\n", i);
+				}
+				if (restarted && wasStreaming)
+				{
+					const stream_controller::mode & m = devices.get_controller(i).get_mode();
+					if (!devices.get_controller(i).get_modes().empty()) printf("Camera %d streaming %dx%d at %d fps\n", i, m.width, m.height, m.framerate);
+				}
+				if (!ready) continue;
+				try
+				{
+					MR_TRACE_SCOPE_ID("sync.push", i);
+					sync.push(i, *cameras[i]);
+				}
+				catch (const rs::error & e)
+				{
+					printf("Camera %d: rs::error calling %s(%s): %s\n", i, e.get_failed_function().c_str(), e.get_failed_args().c_str(), e.what());
+					devices.report_error(i);
+				}
+			}
+		});
 	}
 
 	// Open a GLFW window to display our output
@@ -225,40 +351,82 @@ int main() try
 	//GLFWwindow * win2 = glfwCreateWindow(1280, 960, "librealsense tutorial #3", nullptr, nullptr);
 	glfwSetCursorPosCallback(win, on_cursor_pos);
 	glfwSetMouseButtonCallback(win, on_mouse_button);
+	glfwSetKeyCallback(win, on_key);
 	glfwMakeContextCurrent(win);
+	std::vector<device_frame *> frames;
+	cloud_exporter recorder;
 	while (!glfwWindowShouldClose(win))
 	{
 
 		// Wait for new frame data
 		glfwPollEvents();
 
-		bool hasobj = runCamera(dev, win, 0);
-
-		if (ctx.get_device_count() > 1)
+		// A camera that is being restarted sends nothing, so don't wait for it
+		for (int i = 0; i < (int)cameras.size(); i++) sync.set_enabled(i, devices.is_streaming(i));
+		if (!sync.next(frames))
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		MR_TRACE_SCOPE("frame");
+
+		fusion.begin_frame();
+		double frameTime = 0;
+		for (auto f : frames) if (f) { frameTime = f->host_time; break; }
+		bool hasobj = false;
+		static int idleFrames[MAX_CAMERAS];
+		for (int i = 0; i < (int)cameras.size(); i++)
 		{
-			hasobj |= runCamera(dev2, win, 1);
+			// Frames taken while this camera's projector was off or still settling have no usable depth
+			if (!frames[i] || !lasers.is_usable(i, frames[i]->host_time)) continue;
+			const auto runStart = std::chrono::steady_clock::now();
+			bool processed;
+			bool found = runCamera(*frames[i], fusion, i, processed);
+			stream_controller & controller = devices.get_controller(i);
+			if (processed) controller.report(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - runStart).count(), sync.get_queued_count(i));
+			idleFrames[i] = found ? 0 : idleFrames[i] + 1;
+			controller.set_active(idleFrames[i] < IDLE_FRAMES);
+			lasers.report(i, found);
+			hasobj |= found;
 		}
+		sync.release();
+		lasers.update(sync.now());
+
+		if (hasobj) runWindow(win, fusion);
 
-		if (!hasobj) {
-			static int time = 0;
-			const int SWITCH = 10;
-			time++;
-			if (time == SWITCH)
+		if (recordToggled)
+		{
+			recordToggled = false;
+			if (recorder.is_running())
 			{
-				//dev->enable_stream(rs::stream::depth, rs::preset::best_quality);
-				//dev2->disable_stream(rs::stream::depth);
-				dev->set_option(rs::option::f200_laser_power, 0);
-				dev2->set_option(rs::option::f200_laser_power, 15);
+				recorder.stop();
+				printf("Recording stopped - %llu frames written, %llu dropped, %llu failed, %.1f MB\n", recorder.get_written_count(),
+					recorder.get_dropped_count(), recorder.get_failed_count(), recorder.get_bytes_written() / 1048576.0);
 			}
-			else if (time == 2 * SWITCH)
+			else
 			{
-				//dev->disable_stream(rs::stream::depth);
-				//dev2->enable_stream(rs::stream::depth, rs::preset::best_quality);
-				dev->set_option(rs::option::f200_laser_power, 15);
-				dev2->set_option(rs::option::f200_laser_power, 0);
-				time = 0;
+				char prefix[64];
+				snprintf(prefix, sizeof(prefix), "cloud_%lld", (long long)time(nullptr));
+				recorder.start(prefix, cloud_file_format::pcd, 1);
+				printf("Recording to %s_*.pcd\n", prefix);
 			}
 		}
+		if (traceRequested)
+		{
+			traceRequested = false;
+			if (MR_TRACE_DUMP("trace.json")) printf("Trace written to trace.json\n");
+			else printf("No trace written; build with MR_ENABLE_TRACE to record one\n");
+		}
+		if (recorder.is_running()) recorder.push(fusion.get_points(), fusion.get_colors(), fusion.size(), frameTime);
+
+		if (sync.get_matched_count() % 300 == 0)
+		{
+			printf("Sync - skew %.1f ms (mean %.1f ms)", sync.get_last_skew(), sync.get_mean_skew());
+			for (int i = 0; i < (int)cameras.size(); i++)
+				printf(", camera %d dropped %llu unmatched %llu usable %.1f fps", i, (unsigned long long)sync.get_dropped_count(i),
+					(unsigned long long)sync.get_unmatched_count(i), lasers.get_effective_fps(i));
+			printf("\n");
+		}
 
 		char temp = 'x';
 		//while (temp != '\n')
@@ -0,0 +1,253 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "simd.hpp"
+#ifdef MR_BENCHMARK
+#include <chrono>
+#include <cstdio>
+#endif
+
+////////////////////////////
+// Depth background model //
+////////////////////////////
+
+// Learns the static scene behind the user so that foreground can be found at any distance instead of with a
+// fixed cutoff. Each pixel keeps the depth of the farthest stable surface it has seen and a running mean
+// absolute deviation of that surface, both as 16-bit raw depth units in planar arrays (4 bytes per pixel).
+//
+// Learning, per valid pixel:
+//  - farther than the background by more than the margin: something moved away, the background jumps halfway
+//    towards the new depth;
+//  - within the margin: background and deviation follow the measurement with weight 1/16;
+//  - nearer by more than the margin (foreground): the background creeps forward by max(1, gap / 1024), so an
+//    object that is left in place is absorbed over tens of seconds while a hand held still is not.
+// The margin is min_margin + 4 * deviation, so noisy pixels (edges, far range) need a larger step to count.
+//
+// The model only needs to learn at a fraction of the frame rate; process() segments every frame and learns
+// every interval-th frame after a warmup.
+class background_model
+{
+	std::vector<uint16_t> background, deviation;
+	int width, height;
+	uint16_t min_margin;
+	int interval, warmup, frame;
+
+	static void learn_scalar(const uint16_t * depth, uint16_t * bg, uint16_t * dev, uint16_t min_margin, int begin, int end)
+	{
+		for (int i = begin; i < end; ++i)
+		{
+			const int d = depth[i], b = bg[i], v = dev[i];
+			if (!d) continue;
+			if (!b)
+			{
+				bg[i] = (uint16_t)d;
+				dev[i] = (uint16_t)(d >> 6);
+				continue;
+			}
+			const int margin = std::min(65535, min_margin + 4 * v);
+			const int diff = d - b, gap = diff < 0 ? -diff : diff;
+			if (gap <= margin)
+			{
+				bg[i] = (uint16_t)(b + (diff >= 0 ? diff >> 4 : -(gap >> 4)));
+				dev[i] = (uint16_t)(v + (gap >= v ? (gap - v) >> 4 : -((v - gap) >> 4)));
+			}
+			else if (diff > 0) bg[i] = (uint16_t)(b + (diff >> 1));
+			else bg[i] = (uint16_t)(b - std::max(1, gap >> 10));
+		}
+	}
+
+	static int segment_scalar(const uint16_t * depth, const uint16_t * bg, const uint16_t * dev, uint16_t min_margin, uint8_t * mask, int begin, int end)
+	{
+		int count = 0;
+		for (int i = begin; i < end; ++i)
+		{
+			const int d = depth[i], b = bg[i];
+			const bool fg = d && b && b - d > std::min(65535, min_margin + 4 * dev[i]);
+			mask[i] = fg ? 255 : 0;
+			count += fg;
+		}
+		return count;
+	}
+
+#ifdef MR_SSE2
+	// margin = min_margin + 4 * dev, saturated
+	static __m128i margin_sse2(__m128i dev, __m128i min_margin)
+	{
+		const __m128i dev2 = _mm_adds_epu16(dev, dev);
+		return _mm_adds_epu16(min_margin, _mm_adds_epu16(dev2, dev2));
+	}
+#endif
+public:
+	// min_margin is in raw depth units; interval is how many frames pass between learning steps once warmup
+	// frames have been learned.
+	background_model(int min_margin = 30, int interval = 4, int warmup = 30) : width(), height(), frame()
+	{
+		set_min_margin(min_margin);
+		set_interval(interval);
+		set_warmup(warmup);
+	}
+
+	void set_min_margin(int raw) { min_margin = (uint16_t)std::max(1, std::min(raw, 65535)); }
+	void set_interval(int frames) { interval = std::max(1, frames); }
+	void set_warmup(int frames) { warmup = std::max(0, frames); }
+	int get_min_margin() const { return min_margin; }
+	bool is_warming_up() const { return frame < warmup; }
+
+	const uint16_t * get_background() const { return background.data(); }
+	const uint16_t * get_deviation() const { return deviation.data(); }
+
+	void reset()
+	{
+		std::fill(background.begin(), background.end(), 0);
+		std::fill(deviation.begin(), deviation.end(), 0);
+		frame = 0;
+	}
+
+	// One learning step.
+	void learn(const uint16_t * depth, int w, int h)
+	{
+		if (w != width || h != height)
+		{
+			width = w;
+			height = h;
+			background.assign(w * h, 0);
+			deviation.assign(w * h, 0);
+			frame = 0;
+		}
+
+		const int n = w * h;
+		uint16_t * bg = background.data(), * dev = deviation.data();
+		int i = 0;
+#ifdef MR_SSE2
+		const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1), mm = _mm_set1_epi16((short)min_margin);
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m128i d = _mm_loadu_si128((const __m128i *)(depth + i));
+			const __m128i b = _mm_loadu_si128((const __m128i *)(bg + i));
+			const __m128i v = _mm_loadu_si128((const __m128i *)(dev + i));
+
+			const __m128i up = _mm_subs_epu16(d, b), down = _mm_subs_epu16(b, d), gap = _mm_or_si128(up, down);
+			const __m128i margin = margin_sse2(v, mm);
+			const __m128i outside = mm_cmpgt_epu16(gap, margin);
+			const __m128i farther = _mm_and_si128(outside, _mm_cmpeq_epi16(down, zero));
+			const __m128i nearer = _mm_andnot_si128(farther, outside);
+
+			// within the margin: +-gap/16; farther: +gap/2; nearer: -max(1, gap/1024)
+			__m128i add = mm_select_si128(farther, _mm_srli_epi16(up, 1), _mm_srli_epi16(up, 4));
+			__m128i sub = mm_select_si128(nearer, mm_max_epu16(_mm_srli_epi16(down, 10), one), _mm_srli_epi16(down, 4));
+			add = _mm_andnot_si128(nearer, add);
+			__m128i nb = _mm_sub_epi16(_mm_add_epi16(b, add), sub);
+
+			const __m128i vu = _mm_srli_epi16(_mm_subs_epu16(gap, v), 4), vd = _mm_srli_epi16(_mm_subs_epu16(v, gap), 4);
+			__m128i nv = mm_select_si128(outside, v, _mm_sub_epi16(_mm_add_epi16(v, vu), vd));
+
+			// first valid sample of a pixel initializes it; invalid samples change nothing
+			const __m128i fresh = _mm_cmpeq_epi16(b, zero), invalid = _mm_cmpeq_epi16(d, zero);
+			nb = mm_select_si128(fresh, d, nb);
+			nv = mm_select_si128(fresh, _mm_srli_epi16(d, 6), nv);
+			nb = mm_select_si128(invalid, b, nb);
+			nv = mm_select_si128(invalid, v, nv);
+
+			_mm_storeu_si128((__m128i *)(bg + i), nb);
+			_mm_storeu_si128((__m128i *)(dev + i), nv);
+		}
+#endif
+		learn_scalar(depth, bg, dev, min_margin, i, n);
+	}
+
+	// Writes 255 to mask for pixels significantly in front of the background and 0 elsewhere; returns how many
+	// pixels are foreground. Pixels without a measurement or without a learned background are never foreground.
+	int segment(const uint16_t * depth, uint8_t * mask) const
+	{
+		const int n = width * height;
+		const uint16_t * bg = background.data(), * dev = deviation.data();
+		int i = 0, count = 0;
+#ifdef MR_SSE2
+		const __m128i zero = _mm_setzero_si128(), mm = _mm_set1_epi16((short)min_margin);
+		__m128i total = zero;
+		for (; i + 16 <= n; i += 16)
+		{
+			__m128i fg[2];
+			for (int k = 0; k < 2; ++k)
+			{
+				const __m128i d = _mm_loadu_si128((const __m128i *)(depth + i + 8 * k));
+				const __m128i b = _mm_loadu_si128((const __m128i *)(bg + i + 8 * k));
+				const __m128i v = _mm_loadu_si128((const __m128i *)(dev + i + 8 * k));
+				const __m128i invalid = _mm_or_si128(_mm_cmpeq_epi16(d, zero), _mm_cmpeq_epi16(b, zero));
+				fg[k] = _mm_andnot_si128(invalid, mm_cmpgt_epu16(_mm_subs_epu16(b, d), margin_sse2(v, mm)));
+			}
+			const __m128i m = _mm_packs_epi16(fg[0], fg[1]);
+			_mm_storeu_si128((__m128i *)(mask + i), m);
+			total = _mm_sub_epi8(total, m); // each set byte is -1
+			if ((i & 0x7ff) == 0x7f0)
+			{
+				// flush before the 8-bit counters (at most 255 per lane) can wrap
+				count += _mm_cvtsi128_si32(_mm_sad_epu8(total, zero)) + _mm_extract_epi16(_mm_sad_epu8(total, zero), 4);
+				total = zero;
+			}
+		}
+		const __m128i sad = _mm_sad_epu8(total, zero);
+		count += _mm_cvtsi128_si32(sad) + _mm_extract_epi16(sad, 4);
+#endif
+		return count + segment_scalar(depth, bg, dev, min_margin, mask, i, n);
+	}
+
+	// Segments depth into mask and learns from it at the configured rate; returns the foreground pixel count.
+	int process(const uint16_t * depth, int w, int h, uint8_t * mask)
+	{
+		if (w != width || h != height || frame < warmup || frame % interval == 0) learn(depth, w, h);
+		++frame;
+		return segment(depth, mask);
+	}
+};
+
+#ifdef MR_BENCHMARK
+// Times process() against the fixed 800 mm threshold pointerLib used before (two setTo passes and a compare, in
+// raw units at 1 mm), over repeats synthetic width x height frames: a noisy wall at 1.5 m with holes and a
+// hand-sized patch at 0.6 m that moves every frame. Prints ms per frame for both and what each leaves of a 60 fps
+// frame interval for the rest of the pipeline.
+inline void background_benchmark(int width, int height, int repeats = 300)
+{
+	typedef std::chrono::steady_clock clock;
+	const int n = width * height;
+	std::vector<uint16_t> frame(n), work(n);
+	std::vector<uint8_t> mask(n);
+	background_model model;
+	uint32_t seed = 1;
+	double old_ms = 0, new_ms = 0;
+	int foreground = 0;
+	for (int r = 0; r < repeats; ++r)
+	{
+		const int hx = (r * 3) % std::max(1, width - width / 4), hy = height / 4;
+		for (int y = 0, i = 0; y < height; ++y)
+		{
+			for (int x = 0; x < width; ++x, ++i)
+			{
+				seed = seed * 1664525u + 1013904223u;
+				const bool hand = x >= hx && x < hx + width / 4 && y >= hy && y < hy + height / 2;
+				frame[i] = (seed >> 24) < 8 ? 0 : (uint16_t)((hand ? 600 : 1500) + (int)((seed >> 16) & 7) - 4);
+			}
+		}
+
+		work = frame;
+		auto t0 = clock::now();
+		for (int i = 0; i < n; ++i)
+		{
+			if (work[i] > 800 || work[i] == 0) work[i] = 10000;
+			mask[i] = work[i] < 800 ? 255 : 0;
+		}
+		old_ms += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+		t0 = clock::now();
+		foreground += model.process(frame.data(), width, height, mask.data());
+		new_ms += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+	}
+	old_ms /= repeats;
+	new_ms /= repeats;
+	const double interval = 1000.0 / 60;
+	printf("Background model, %dx%d, %d frames (mean foreground %d px)\n", width, height, repeats, foreground / repeats);
+	printf("    threshold %.3f ms, model %.3f ms per frame; %.2f ms and %.2f ms of the %.2f ms frame interval left\n", old_ms, new_ms,
+		interval - old_ms, interval - new_ms, interval);
+}
+#endif
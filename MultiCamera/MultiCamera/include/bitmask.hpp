@@ -0,0 +1,188 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "simd.hpp"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+///////////////////////
+// 1-bpp pixel masks //
+///////////////////////
+
+// Population count and lowest set bit of a 64-bit word. The POPCNT instruction is not part of the SSE2 baseline,
+// so it is only used when the compiler is told it exists (/arch:AVX and up, or -mpopcnt).
+inline int popcount64(uint64_t v)
+{
+#if defined(__POPCNT__) || (defined(_MSC_VER) && defined(_M_X64) && defined(__AVX__))
+#if defined(_MSC_VER)
+	return (int)__popcnt64(v);
+#else
+	return __builtin_popcountll(v);
+#endif
+#else
+	v = v - ((v >> 1) & 0x5555555555555555ull);
+	v = (v & 0x3333333333333333ull) + ((v >> 2) & 0x3333333333333333ull);
+	v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0full;
+	return (int)((v * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+inline int lowest_bit64(uint64_t v) // v must not be 0
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long i;
+	_BitScanForward64(&i, v);
+	return (int)i;
+#elif defined(_MSC_VER)
+	unsigned long i;
+	if (_BitScanForward(&i, (unsigned long)v)) return (int)i;
+	_BitScanForward(&i, (unsigned long)(v >> 32));
+	return (int)i + 32;
+#else
+	return __builtin_ctzll(v);
+#endif
+}
+
+// One bit per pixel, each row padded to whole 64-bit words so rows can be combined and counted a word at a time.
+// A 640x480 mask is 38 KB against 300 KB for an 8-bit one. Padding bits are always 0.
+class bitmask
+{
+	std::vector<uint64_t> words;
+	int width, height, stride; // stride in words
+public:
+	bitmask() : width(), height(), stride() {}
+	bitmask(int w, int h) : width(), height(), stride() { resize(w, h); }
+
+	// Contents are undefined after a size change until the mask is filled or cleared.
+	void resize(int w, int h)
+	{
+		if (w == width && h == height) return;
+		width = w;
+		height = h;
+		stride = (w + 63) / 64;
+		words.assign((size_t)stride * h, 0);
+	}
+	void clear() { std::fill(words.begin(), words.end(), 0); }
+
+	int get_width() const { return width; }
+	int get_height() const { return height; }
+	int get_stride() const { return stride; }
+	const uint64_t * row(int y) const { return words.data() + (size_t)y * stride; }
+	uint64_t * row(int y) { return words.data() + (size_t)y * stride; }
+
+	bool get(int x, int y) const { return (row(y)[x >> 6] >> (x & 63)) & 1; }
+	void set(int x, int y, bool v)
+	{
+		uint64_t & w = row(y)[x >> 6];
+		const uint64_t bit = 1ull << (x & 63);
+		w = v ? w | bit : w & ~bit;
+	}
+
+	// Sets the bits of the pixels with lo <= depth <= hi, in raw depth units. A lo of 1 or more leaves out
+	// pixels without data. Sixteen pixels per step: an unsigned range compare, a pack to bytes and a movemask.
+	void from_depth_range(const uint16_t * depth, int w, int h, uint16_t lo, uint16_t hi)
+	{
+		resize(w, h);
+		const uint16_t range = hi >= lo ? (uint16_t)(hi - lo) : 0;
+		for (int y = 0; y < h; ++y)
+		{
+			const uint16_t * d = depth + (size_t)y * w;
+			uint64_t * out = row(y);
+			int x = 0;
+			if (hi < lo)
+			{
+				std::fill(out, out + stride, 0);
+				continue;
+			}
+#ifdef MR_SSE2
+			const __m128i vlo = _mm_set1_epi16((short)lo), vrange = _mm_set1_epi16((short)range);
+			for (; x + 64 <= w; x += 64)
+			{
+				uint64_t bits = 0;
+				for (int k = 0; k < 64; k += 16)
+				{
+					// (d - lo) <= range, unsigned, is lo <= d <= hi
+					const __m128i a = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(d + x + k)), vlo);
+					const __m128i b = _mm_sub_epi16(_mm_loadu_si128((const __m128i *)(d + x + k + 8)), vlo);
+					const __m128i in = _mm_packs_epi16(mm_cmpgt_epu16(a, vrange), mm_cmpgt_epu16(b, vrange));
+					bits |= (uint64_t)(uint16_t)~_mm_movemask_epi8(in) << k;
+				}
+				out[x >> 6] = bits;
+			}
+#endif
+			for (; x < w; x += 64)
+			{
+				const int n = std::min(64, w - x);
+				uint64_t bits = 0;
+				for (int k = 0; k < n; ++k) bits |= (uint64_t)((uint16_t)(d[x + k] - lo) <= range) << k;
+				out[x >> 6] = bits;
+			}
+		}
+	}
+
+	size_t count() const
+	{
+		size_t n = 0;
+		for (uint64_t w : words) n += popcount64(w);
+		return n;
+	}
+
+	int count_row(int y) const
+	{
+		const uint64_t * r = row(y);
+		int n = 0;
+		for (int i = 0; i < stride; ++i) n += popcount64(r[i]);
+		return n;
+	}
+
+	// Set bits in the rectangle [x, x + w) x [y, y + h), clipped to the mask.
+	size_t count_rect(int x, int y, int w, int h) const
+	{
+		const int x0 = std::max(x, 0), x1 = std::min(x + w, width), y0 = std::max(y, 0), y1 = std::min(y + h, height);
+		if (x0 >= x1 || y0 >= y1) return 0;
+		const int first = x0 >> 6, last = (x1 - 1) >> 6;
+		const uint64_t head = ~0ull << (x0 & 63), tail = ~0ull >> (63 - ((x1 - 1) & 63));
+		size_t n = 0;
+		for (int yy = y0; yy < y1; ++yy)
+		{
+			const uint64_t * r = row(yy);
+			if (first == last)
+			{
+				n += popcount64(r[first] & head & tail);
+				continue;
+			}
+			n += popcount64(r[first] & head);
+			for (int i = first + 1; i < last; ++i) n += popcount64(r[i]);
+			n += popcount64(r[last] & tail);
+		}
+		return n;
+	}
+
+	// this = a op b, for masks of the same size: intersections, unions, changed pixels (xor) and a & ~b.
+	void assign_and(const bitmask & a, const bitmask & b) { combine(a, b, [](uint64_t p, uint64_t q) { return p & q; }); }
+	void assign_or(const bitmask & a, const bitmask & b) { combine(a, b, [](uint64_t p, uint64_t q) { return p | q; }); }
+	void assign_xor(const bitmask & a, const bitmask & b) { combine(a, b, [](uint64_t p, uint64_t q) { return p ^ q; }); }
+	void assign_andnot(const bitmask & a, const bitmask & b) { combine(a, b, [](uint64_t p, uint64_t q) { return p & ~q; }); }
+
+	template<class OP> void combine(const bitmask & a, const bitmask & b, OP op)
+	{
+		resize(a.width, a.height);
+		const size_t n = words.size();
+		for (size_t i = 0; i < n; ++i) words[i] = op(a.words[i], b.words[i]);
+	}
+
+	// Calls f(x, y) for every set pixel in row-major order; cost follows the set pixels, not the frame.
+	template<class F> void for_each(F f) const
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			const uint64_t * r = row(y);
+			for (int i = 0; i < stride; ++i)
+			{
+				for (uint64_t w = r[i]; w; w &= w - 1) f(i * 64 + lowest_bit64(w), y);
+			}
+		}
+	}
+};
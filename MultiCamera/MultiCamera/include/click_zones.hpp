@@ -0,0 +1,244 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "bitmask.hpp"
+#include "depth_range.hpp"
+
+//////////////////////////
+// Zone click detection //
+//////////////////////////
+
+// A virtual button: a box in camera space (meters). Thresholds are fractions of the zone's area in the image,
+// so they hold whatever the zone's size, the decimation or the sensor resolution.
+struct click_zone
+{
+	rs::float3 min, max;
+	float primary;     // rise of the covered fraction above the baseline that presses the zone
+	float secondary;   // fall below the baseline that fires a secondary click
+};
+
+const float CLICK_PRIMARY_FRACTION = 0.15f, CLICK_SECONDARY_FRACTION = 0.10f;
+
+// Nearest a box corner is projected from; a box starting at the camera (z = 0) would project to infinity and
+// just covers the whole image.
+const float CLICK_MIN_PROJECTION_Z = 0.05f;
+
+enum class click_kind { primary, secondary, release };
+
+struct click_event
+{
+	int zone;
+	click_kind kind;
+	int count;        // near pixels in the zone this frame
+	float baseline;
+};
+
+// Evaluates any number of zones against a depth frame. Zones that share a depth range share one 1-bit mask and
+// one summed-area table, built once per frame, and each zone then costs four table reads however large it is,
+// so a hundred buttons on one surface cost about the same as one.
+//
+// A zone covers the pixels its box projects to and counts those whose depth lies in the box's z range. The
+// projection ignores lens distortion and takes the box's bounding rectangle, so a zone well off the optical
+// axis or a box that is not facing the camera gathers some pixels just outside its x/y bounds. Give buttons a
+// shallow z range in front of the surface they sit on: a box reaching back to the camera covers most of the image.
+//
+// Each zone tracks its own baseline, a running average of its count that follows slow changes (someone
+// standing in view, a chair moved) and is frozen while the zone is held, so only the zone a hand actually
+// enters fires.
+class click_detector
+{
+	struct layer
+	{
+		uint16_t lo, hi;            // raw depth range
+		bitmask mask;
+		std::vector<uint32_t> sat;  // (width + 1) x (height + 1), first row and column 0
+	};
+
+	struct zone_state
+	{
+		click_zone zone;
+		int layer;
+		int x0, y0, x1, y1;     // pixel rectangle, end exclusive
+		int area;
+		float baseline;
+		bool warm;              // baseline has been seeded
+		click_kind state;       // release when idle
+		int held;               // frames in the current state
+	};
+
+	std::vector<zone_state> zones;
+	std::vector<layer> layers;
+	std::vector<click_event> events;
+	rs::intrinsics intrin;
+	float scale;
+	bool configured;
+
+	void configure(const rs::intrinsics & in, float depth_scale)
+	{
+		intrin = in;
+		scale = depth_scale;
+		configured = true;
+		layers.clear();
+		for (auto & z : zones) place(z);
+	}
+
+	void place(zone_state & s)
+	{
+		const click_zone & z = s.zone;
+		depth_range range(z.min.z, z.max.z);
+		range.configure(scale);
+		const uint16_t lo = range.get_lo(), hi = range.get_hi();
+		s.layer = -1;
+		for (size_t i = 0; i < layers.size(); ++i) if (layers[i].lo == lo && layers[i].hi == hi) s.layer = (int)i;
+		if (s.layer < 0)
+		{
+			layers.push_back(layer());
+			layers.back().lo = lo;
+			layers.back().hi = hi;
+			s.layer = (int)layers.size() - 1;
+		}
+
+		float px0 = (float)intrin.width, py0 = (float)intrin.height, px1 = 0, py1 = 0;
+		for (int c = 0; c < 8; ++c)
+		{
+			const float x = c & 1 ? z.max.x : z.min.x, y = c & 2 ? z.max.y : z.min.y;
+			const float d = std::max(c & 4 ? z.max.z : z.min.z, CLICK_MIN_PROJECTION_Z);
+			const float u = intrin.fx * x / d + intrin.ppx, v = intrin.fy * y / d + intrin.ppy;
+			px0 = std::min(px0, u); py0 = std::min(py0, v);
+			px1 = std::max(px1, u); py1 = std::max(py1, v);
+		}
+		s.x0 = std::max(0, (int)std::floor(px0));
+		s.y0 = std::max(0, (int)std::floor(py0));
+		s.x1 = std::min(intrin.width, (int)std::ceil(px1) + 1);
+		s.y1 = std::min(intrin.height, (int)std::ceil(py1) + 1);
+		if (s.x1 < s.x0) s.x1 = s.x0;
+		if (s.y1 < s.y0) s.y1 = s.y0;
+		s.area = (s.x1 - s.x0) * (s.y1 - s.y0);
+		s.warm = false;
+		s.state = click_kind::release;
+	}
+
+	static void build_sat(layer & l)
+	{
+		const int w = l.mask.get_width(), h = l.mask.get_height(), sw = w + 1;
+		l.sat.resize((size_t)sw * (h + 1));
+		std::fill(l.sat.begin(), l.sat.begin() + sw, 0);
+		for (int y = 0; y < h; ++y)
+		{
+			const uint64_t * bits = l.mask.row(y);
+			const uint32_t * above = l.sat.data() + (size_t)y * sw;
+			uint32_t * out = l.sat.data() + (size_t)(y + 1) * sw;
+			uint32_t run = 0;
+			out[0] = 0;
+			for (int x = 0; x < w; ++x)
+			{
+				run += (bits[x >> 6] >> (x & 63)) & 1;
+				out[x + 1] = above[x + 1] + run;
+			}
+		}
+	}
+
+	static int rect_sum(const layer & l, int x0, int y0, int x1, int y1)
+	{
+		const int sw = l.mask.get_width() + 1;
+		const uint32_t * s = l.sat.data();
+		return (int)(s[y1 * sw + x1] - s[y0 * sw + x1] - s[y1 * sw + x0] + s[y0 * sw + x0]);
+	}
+public:
+	// Rate at which an idle zone's baseline follows its count; 0.1 averages over roughly the last ten frames.
+	float baseline_rate = 0.1f;
+	// A zone held longer than this is taken to be a lasting change of the scene: it is released and its
+	// baseline restarts from the current count.
+	int max_hold_frames = 300;
+
+	click_detector() : scale(), configured() { intrin = {}; }
+
+	// Returns the zone's index, which events refer to.
+	int add_zone(const click_zone & zone)
+	{
+		zone_state s = {};
+		s.zone = zone;
+		zones.push_back(s);
+		if (configured) place(zones.back());
+		return (int)zones.size() - 1;
+	}
+
+	// Tiles the x/y extent of a box with columns x rows zones sharing its depth range, row by row from the top left.
+	void add_grid(const rs::float3 & min, const rs::float3 & max, int columns, int rows,
+		float primary = CLICK_PRIMARY_FRACTION, float secondary = CLICK_SECONDARY_FRACTION)
+	{
+		for (int r = 0; r < rows; ++r)
+		{
+			for (int c = 0; c < columns; ++c)
+			{
+				click_zone z;
+				z.min = { min.x + (max.x - min.x) * c / columns, min.y + (max.y - min.y) * r / rows, min.z };
+				z.max = { min.x + (max.x - min.x) * (c + 1) / columns, min.y + (max.y - min.y) * (r + 1) / rows, max.z };
+				z.primary = primary;
+				z.secondary = secondary;
+				add_zone(z);
+			}
+		}
+	}
+
+	int zone_count() const { return (int)zones.size(); }
+	int layer_count() const { return (int)layers.size(); }
+	float get_baseline(int zone) const { return zones[zone].baseline; }
+	click_kind get_state(int zone) const { return zones[zone].state; }
+
+	// Checks every zone against a z16 frame and returns what changed: presses, secondary clicks and releases.
+	// The returned list is valid until the next call.
+	const std::vector<click_event> & process(const uint16_t * depth, const rs::intrinsics & in, float depth_scale)
+	{
+		events.clear();
+		if (!configured || in.width != intrin.width || in.height != intrin.height || in.fx != intrin.fx || in.fy != intrin.fy
+			|| in.ppx != intrin.ppx || in.ppy != intrin.ppy || depth_scale != scale) configure(in, depth_scale);
+
+		for (auto & l : layers)
+		{
+			l.mask.from_depth_range(depth, in.width, in.height, l.lo, l.hi);
+			build_sat(l);
+		}
+
+		for (size_t i = 0; i < zones.size(); ++i)
+		{
+			zone_state & s = zones[i];
+			if (s.area == 0) continue;
+			const int count = rect_sum(layers[s.layer], s.x0, s.y0, s.x1, s.y1);
+			if (!s.warm)
+			{
+				s.baseline = (float)count;
+				s.warm = true;
+				continue;
+			}
+
+			const float rise = (count - s.baseline) / s.area, fall = -rise;
+			click_kind next = s.state;
+			if (s.state == click_kind::release)
+			{
+				if (rise > s.zone.primary) next = click_kind::primary;
+				else if (fall > s.zone.secondary) next = click_kind::secondary;
+				else s.baseline += (count - s.baseline) * baseline_rate;
+			}
+			// half the threshold to let go, so a count hovering at the threshold does not chatter
+			else if (s.state == click_kind::primary && rise < s.zone.primary * 0.5f) next = click_kind::release;
+			else if (s.state == click_kind::secondary && fall < s.zone.secondary * 0.5f) next = click_kind::release;
+			else if (++s.held > max_hold_frames)
+			{
+				next = click_kind::release;
+				s.baseline = (float)count;
+			}
+
+			if (next != s.state)
+			{
+				s.state = next;
+				s.held = 0;
+				events.push_back({ (int)i, next, count, s.baseline });
+			}
+		}
+		return events;
+	}
+};
@@ -0,0 +1,326 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "spsc_ring.hpp"
+
+//////////////////////////////
+// Streaming cloud recorder //
+//////////////////////////////
+
+enum class cloud_file_format { ply, pcd };
+
+// LZF compression as read by liblzf's lzf_decompress (and so by PCL for binary_compressed PCD files).
+// hash_bits sizes the match table: more bits find more matches at the cost of a bigger table to clear per call;
+// rehash also indexes the positions inside each match, which is slower but finds more of the next matches.
+// out must hold n + n / 32 + 1 bytes, the size of input that does not compress at all. Returns the output size.
+inline size_t lzf_compress(const uint8_t * in, size_t n, uint8_t * out, int hash_bits, bool rehash, std::vector<uint32_t> & table)
+{
+	const uint32_t none = 0xffffffff, hash_size = 1u << hash_bits;
+	table.assign(hash_size, none);
+	auto hash = [&](size_t i) { return ((in[i] << 16 | in[i + 1] << 8 | in[i + 2]) * 2654435761u) >> (32 - hash_bits); };
+
+	// Literal runs are written behind a control byte holding run length - 1 (at most 32 per run), which is
+	// filled in once the run ends. A back reference is (length - 2) << 5 | offset high bits, then an extra
+	// length byte if length - 2 >= 7, then the offset low byte, with offset = distance - 1 < 8192.
+	size_t ip = 0, op = 1, lit = 0;
+	while (ip + 2 < n)
+	{
+		const uint32_t h = hash(ip), ref = table[h];
+		table[h] = (uint32_t)ip;
+		if (ref != none && ip - ref - 1 < 8192 && in[ref] == in[ip] && in[ref + 1] == in[ip + 1] && in[ref + 2] == in[ip + 2])
+		{
+			const size_t off = ip - ref - 1, max_len = std::min<size_t>(264, n - ip);
+			size_t len = 3;
+			while (len < max_len && in[ref + len] == in[ip + len]) ++len;
+
+			if (lit) out[op - lit - 1] = (uint8_t)(lit - 1);
+			else --op; // no literals since the last match, so drop the reserved control byte
+			const size_t l = len - 2;
+			if (l < 7) out[op++] = (uint8_t)(off >> 8 | l << 5);
+			else
+			{
+				out[op++] = (uint8_t)(off >> 8 | 7 << 5);
+				out[op++] = (uint8_t)(l - 7);
+			}
+			out[op++] = (uint8_t)off;
+			lit = 0;
+			++op;
+
+			if (rehash)
+				for (size_t i = ip + 1; i < ip + len && i + 2 < n; ++i) table[hash(i)] = (uint32_t)i;
+			ip += len;
+			continue;
+		}
+
+		out[op++] = in[ip++];
+		if (++lit == 32)
+		{
+			out[op - lit - 1] = 31;
+			lit = 0;
+			++op;
+		}
+	}
+	while (ip < n)
+	{
+		out[op++] = in[ip++];
+		if (++lit == 32)
+		{
+			out[op - lit - 1] = 31;
+			lit = 0;
+			++op;
+		}
+	}
+	if (lit) out[op - lit - 1] = (uint8_t)(lit - 1);
+	else --op;
+	return op;
+}
+
+// Records a stream of colored clouds to disk, one binary PLY or PCD file per frame, named
+// <prefix>_<frame number>.ply/.pcd. push() copies the frame into a preallocated queue slot and returns at once;
+// a writer thread serializes and writes it, so the capture and render loops never wait on the disk. When the
+// disk falls behind far enough to fill the queue, whole frames are dropped and counted instead; frame numbers
+// count pushed frames, so a drop leaves a gap in the file names.
+//
+// Files are staged in a page-aligned buffer and written unbuffered in BLOCK_SIZE chunks, so the OS sees a few
+// large aligned writes per frame rather than many small ones. compression_level 0 writes plain binary files;
+// 1 to 6 write PCD as binary_compressed (LZF over the fields stored one after another, with a bigger match
+// table and rehashing from level 4 up). PLY has no compressed variant, so the level is ignored for it.
+class cloud_exporter
+{
+	struct frame
+	{
+		std::vector<rs::float3> points;
+		std::vector<uint8_t> colors;
+		size_t count;
+		double timestamp;
+		unsigned long long number;
+	};
+
+	static const size_t QUEUE_SIZE = 16;
+	static const size_t BLOCK_SIZE = 1 << 20;
+	static const size_t STAGING_ALIGNMENT = 4096;
+
+	spsc_ring<frame, QUEUE_SIZE> queue;
+	std::thread writer;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::atomic<bool> running;
+	std::atomic<unsigned long long> written, dropped, failed, bytes;
+	unsigned long long frames;
+	std::string prefix;
+	cloud_file_format format;
+	int level;
+
+	// Writer-side state, only touched by the writer thread
+	std::vector<uint8_t> staging_storage, raw, packed;
+	std::vector<uint32_t> table;
+	uint8_t * staging;
+	size_t staged;
+	FILE * file;
+	bool file_ok;
+
+	void flush()
+	{
+		if (!staged) return;
+		if (file_ok && fwrite(staging, 1, staged, file) != staged) file_ok = false;
+		bytes += staged;
+		staged = 0;
+	}
+
+	void put(const void * data, size_t size)
+	{
+		const uint8_t * p = (const uint8_t *)data;
+		while (size)
+		{
+			const size_t n = std::min(size, BLOCK_SIZE - staged);
+			memcpy(staging + staged, p, n);
+			staged += n;
+			p += n;
+			size -= n;
+			if (staged == BLOCK_SIZE) flush();
+		}
+	}
+
+	void write_ply(const frame & f)
+	{
+		char header[512];
+		const int n = snprintf(header, sizeof(header),
+			"ply\nformat binary_little_endian 1.0\ncomment frame %llu timestamp %.3f\nelement vertex %llu\n"
+			"property float x\nproperty float y\nproperty float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n",
+			f.number, f.timestamp, (unsigned long long)f.count);
+		put(header, n);
+
+		uint8_t vertex[15];
+		for (size_t i = 0; i < f.count; ++i)
+		{
+			memcpy(vertex, &f.points[i], 12);
+			memcpy(vertex + 12, &f.colors[i * 3], 3);
+			put(vertex, sizeof(vertex));
+		}
+	}
+
+	void write_pcd(const frame & f)
+	{
+		char header[512];
+		const int n = snprintf(header, sizeof(header),
+			"# .PCD v0.7 - Point Cloud Data file format\n# frame %llu timestamp %.3f\nVERSION 0.7\nFIELDS x y z rgb\n"
+			"SIZE 4 4 4 4\nTYPE F F F U\nCOUNT 1 1 1 1\nWIDTH %llu\nHEIGHT 1\nVIEWPOINT 0 0 0 1 0 0 0\nPOINTS %llu\nDATA %s\n",
+			f.number, f.timestamp, (unsigned long long)f.count, (unsigned long long)f.count, level > 0 ? "binary_compressed" : "binary");
+		put(header, n);
+
+		// PCL packs rgb as 0x00RRGGBB
+		auto rgb = [&](size_t i) { const uint8_t * c = &f.colors[i * 3]; return (uint32_t)c[0] << 16 | (uint32_t)c[1] << 8 | c[2]; };
+
+		if (level <= 0)
+		{
+			uint8_t point[16];
+			for (size_t i = 0; i < f.count; ++i)
+			{
+				const uint32_t c = rgb(i);
+				memcpy(point, &f.points[i], 12);
+				memcpy(point + 12, &c, 4);
+				put(point, sizeof(point));
+			}
+			return;
+		}
+
+		// binary_compressed stores each field for all points in turn, which groups similar bytes for LZF
+		const size_t size = f.count * 16;
+		raw.resize(size);
+		packed.resize(size + size / 32 + 1);
+		float * x = (float *)raw.data(), * y = x + f.count, * z = y + f.count;
+		uint32_t * c = (uint32_t *)(z + f.count);
+		for (size_t i = 0; i < f.count; ++i)
+		{
+			x[i] = f.points[i].x;
+			y[i] = f.points[i].y;
+			z[i] = f.points[i].z;
+			c[i] = rgb(i);
+		}
+		const uint32_t sizes[2] = { (uint32_t)lzf_compress(raw.data(), size, packed.data(), std::min(12 + level, 18), level >= 4, table), (uint32_t)size };
+		put(sizes, sizeof(sizes));
+		put(packed.data(), sizes[0]);
+	}
+
+	void write(const frame & f)
+	{
+		char path[1024];
+		snprintf(path, sizeof(path), "%s_%06llu.%s", prefix.c_str(), f.number, format == cloud_file_format::ply ? "ply" : "pcd");
+		file = fopen(path, "wb");
+		if (!file)
+		{
+			printf("Could not open %s for writing\n", path);
+			++failed;
+			return;
+		}
+		// Our writes are already large and aligned; stdio buffering would only add a copy
+		setvbuf(file, nullptr, _IONBF, 0);
+		file_ok = true;
+
+		if (format == cloud_file_format::ply) write_ply(f);
+		else write_pcd(f);
+		flush();
+
+		if (fclose(file) != 0) file_ok = false;
+		file = nullptr;
+		if (file_ok) ++written;
+		else
+		{
+			printf("Error writing %s\n", path);
+			++failed;
+		}
+	}
+
+	void write_loop()
+	{
+		for (;;)
+		{
+			if (frame * f = queue.front())
+			{
+				write(*f);
+				queue.pop();
+				continue;
+			}
+			if (!running) return;
+
+			// push() notifies without taking the lock so it can never block; the timeout covers a missed wakeup
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait_for(lock, std::chrono::milliseconds(10), [&] { return !running || queue.size() > 0; });
+		}
+	}
+public:
+	cloud_exporter() : running(false), written(0), dropped(0), failed(0), bytes(0), frames(0), format(cloud_file_format::ply), level(0),
+		staging(), staged(0), file(), file_ok(false)
+	{
+		staging_storage.resize(BLOCK_SIZE + STAGING_ALIGNMENT);
+		staging = staging_storage.data() + (STAGING_ALIGNMENT - (uintptr_t)staging_storage.data() % STAGING_ALIGNMENT) % STAGING_ALIGNMENT;
+	}
+	~cloud_exporter() { stop(); }
+
+	// Starts a recording; files are named from path_prefix, which may include a directory.
+	void start(const std::string & path_prefix, cloud_file_format file_format, int compression_level = 0)
+	{
+		stop();
+		prefix = path_prefix;
+		format = file_format;
+		level = std::max(0, std::min(compression_level, 6));
+		frames = 0;
+		written = dropped = failed = bytes = 0;
+		running = true;
+		writer = std::thread(&cloud_exporter::write_loop, this);
+	}
+
+	// Stops accepting frames and waits until the queued ones are on disk.
+	void stop()
+	{
+		if (!writer.joinable()) return;
+		running = false;
+		wake.notify_one();
+		writer.join();
+	}
+
+	bool is_running() const { return running; }
+
+	// Queues a copy of the cloud. Returns false and counts a dropped frame if the queue is full. The slot
+	// buffers only grow, so in steady state this is two memcpys.
+	bool push(const rs::float3 * points, const uint8_t * colors, size_t count, double timestamp)
+	{
+		if (!running) return false;
+		const unsigned long long number = frames++;
+		frame * f = queue.acquire_write();
+		if (!f)
+		{
+			++dropped;
+			return false;
+		}
+		if (f->points.size() < count)
+		{
+			f->points.resize(count);
+			f->colors.resize(count * 3);
+		}
+		memcpy(f->points.data(), points, count * sizeof(rs::float3));
+		memcpy(f->colors.data(), colors, count * 3);
+		f->count = count;
+		f->timestamp = timestamp;
+		f->number = number;
+		queue.commit_write();
+		wake.notify_one();
+		return true;
+	}
+
+	unsigned long long get_written_count() const { return written; }
+	unsigned long long get_dropped_count() const { return dropped; }
+	unsigned long long get_failed_count() const { return failed; }
+	unsigned long long get_bytes_written() const { return bytes; }
+	size_t get_queue_depth() const { return queue.size(); }
+};
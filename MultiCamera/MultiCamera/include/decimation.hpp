@@ -0,0 +1,179 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "simd.hpp"
+
+////////////////////////////
+// Depth decimation stage //
+////////////////////////////
+
+// How the factor x factor block of depth pixels is reduced to one output pixel.
+// Zero means "no data" in a z16 frame, so both modes ignore zeros and only output zero for empty blocks.
+enum class bin_mode
+{
+	median,      // lower median of the valid pixels, keeps edges sharp and rejects single-pixel noise
+	min_nonzero  // closest valid pixel, never loses thin near objects such as fingers
+};
+
+const int MAX_DECIMATION = 4;
+
+// Intrinsics of a frame decimated by factor. Each output pixel covers a whole block, so its centre
+// sits in the middle of that block rather than on the block's top-left input pixel.
+inline rs::intrinsics decimate_intrinsics(const rs::intrinsics & in, int factor)
+{
+	rs::intrinsics out = in;
+	out.width = in.width / factor;
+	out.height = in.height / factor;
+	out.ppx = (in.ppx + 0.5f) / factor - 0.5f;
+	out.ppy = (in.ppy + 0.5f) / factor - 0.5f;
+	out.fx = in.fx / factor;
+	out.fy = in.fy / factor;
+	return out;
+}
+
+namespace decimation_detail
+{
+	inline uint16_t bin_scalar(const uint16_t * in, int stride, int factor, bin_mode mode)
+	{
+		uint16_t samples[MAX_DECIMATION * MAX_DECIMATION];
+		int count = 0;
+		for (int r = 0; r < factor; ++r, in += stride)
+			for (int c = 0; c < factor; ++c)
+				if (in[c]) samples[count++] = in[c];
+
+		if (count == 0) return 0;
+		if (mode == bin_mode::min_nonzero) return *std::min_element(samples, samples + count);
+		std::nth_element(samples, samples + (count - 1) / 2, samples + count);
+		return samples[(count - 1) / 2];
+	}
+
+#ifdef MR_SSE2
+	// Gathers the block samples for 8 consecutive output pixels, one vector per position inside the block.
+	inline int gather_bins(const uint16_t * in, int stride, int factor, __m128i * s)
+	{
+		int n = 0;
+		for (int r = 0; r < factor; ++r, in += stride)
+		{
+			if (factor == 2)
+			{
+				// De-interleave even and odd columns: sign-extend each half so packs_epi32 keeps the bits intact.
+				__m128i a = _mm_loadu_si128((const __m128i *)in), b = _mm_loadu_si128((const __m128i *)(in + 8));
+				s[n++] = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+				s[n++] = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+			}
+			else
+			{
+				for (int c = 0; c < factor; ++c)
+				{
+					const uint16_t * p = in + c;
+					s[n++] = _mm_setr_epi16((short)p[0], (short)p[factor], (short)p[2 * factor], (short)p[3 * factor],
+						(short)p[4 * factor], (short)p[5 * factor], (short)p[6 * factor], (short)p[7 * factor]);
+				}
+			}
+		}
+		return n;
+	}
+
+	// Bins 8 output pixels at once. Samples are biased by -1 so that zero wraps to 0xFFFF and sorts after every
+	// valid depth; adding 1 back turns an all-invalid block into zero again.
+	inline __m128i bin_sse2(const uint16_t * in, int stride, int factor, bin_mode mode)
+	{
+		__m128i s[MAX_DECIMATION * MAX_DECIMATION];
+		const int n = gather_bins(in, stride, factor, s);
+		const __m128i one = _mm_set1_epi16(1), zero = _mm_setzero_si128();
+
+		if (mode == bin_mode::min_nonzero)
+		{
+			__m128i m = _mm_sub_epi16(s[0], one);
+			for (int i = 1; i < n; ++i) m = mm_min_epu16(m, _mm_sub_epi16(s[i], one));
+			return _mm_add_epi16(m, one);
+		}
+
+		// Count the valid samples per lane: cmpeq yields -1 for every zero sample.
+		__m128i valid = _mm_set1_epi16((short)n);
+		for (int i = 0; i < n; ++i)
+		{
+			valid = _mm_add_epi16(valid, _mm_cmpeq_epi16(s[i], zero));
+			s[i] = _mm_sub_epi16(s[i], one);
+		}
+
+		// Odd-even transposition sort, lane-wise across the n vectors.
+		for (int pass = 0; pass < n; ++pass)
+		{
+			for (int i = pass & 1; i + 1 < n; i += 2)
+			{
+				__m128i lo = mm_min_epu16(s[i], s[i + 1]);
+				s[i + 1] = mm_max_epu16(s[i], s[i + 1]);
+				s[i] = lo;
+			}
+		}
+
+		// Pick the lower median of the valid samples; lanes with no valid samples get index -1 and keep 0xFFFF.
+		const __m128i index = _mm_srai_epi16(_mm_sub_epi16(valid, one), 1);
+		__m128i result = _mm_set1_epi16(-1);
+		for (int i = 0; i < (n + 1) / 2; ++i)
+			result = mm_select_si128(_mm_cmpeq_epi16(index, _mm_set1_epi16((short)i)), s[i], result);
+		return _mm_add_epi16(result, one);
+	}
+#endif
+}
+
+// Reduces a z16 frame by factor (1 to MAX_DECIMATION) in each dimension. Partial blocks on the right and
+// bottom edges are dropped, matching decimate_intrinsics. out must hold (width / factor) * (height / factor) pixels.
+inline void decimate_depth(const uint16_t * in, int width, int height, int factor, bin_mode mode, uint16_t * out)
+{
+	if (factor <= 1)
+	{
+		std::copy(in, in + width * height, out);
+		return;
+	}
+
+	const int out_width = width / factor, out_height = height / factor;
+	for (int y = 0; y < out_height; ++y)
+	{
+		const uint16_t * row = in + y * factor * width;
+		uint16_t * dst = out + y * out_width;
+		int x = 0;
+#ifdef MR_SSE2
+		// The factor 2 path loads 16 input pixels per row, which stays inside the row for every full group of 8.
+		for (; x + 8 <= out_width; x += 8)
+			_mm_storeu_si128((__m128i *)(dst + x), decimation_detail::bin_sse2(row + x * factor, width, factor, mode));
+#endif
+		for (; x < out_width; ++x)
+			dst[x] = decimation_detail::bin_scalar(row + x * factor, width, factor, mode);
+	}
+}
+
+// Owns the output buffer and intrinsics of one decimated stream, so each consumer can
+// keep its own instance at whatever resolution it needs.
+class depth_decimator
+{
+	int factor;
+	bin_mode mode;
+	rs::intrinsics intrin;
+	std::vector<uint16_t> frame;
+	const uint16_t * output;
+public:
+	depth_decimator(int factor = 2, bin_mode mode = bin_mode::median) : factor(), mode(mode), intrin(), output() { set_factor(factor); }
+
+	void set_factor(int f) { factor = std::max(1, std::min(f, MAX_DECIMATION)); }
+	void set_mode(bin_mode m) { mode = m; }
+	int get_factor() const { return factor; }
+	bin_mode get_mode() const { return mode; }
+
+	const rs::intrinsics & get_intrinsics() const { return intrin; }
+	const uint16_t * get_data() const { return output; }
+
+	// At factor 1 the input frame is passed through untouched instead of copied.
+	const uint16_t * process(const uint16_t * depth, const rs::intrinsics & depth_intrin)
+	{
+		intrin = decimate_intrinsics(depth_intrin, factor);
+		if (factor == 1) return output = depth;
+
+		frame.resize(intrin.width * intrin.height);
+		decimate_depth(depth, depth_intrin.width, depth_intrin.height, factor, mode, frame.data());
+		return output = frame.data();
+	}
+};
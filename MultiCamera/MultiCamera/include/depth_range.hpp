@@ -0,0 +1,133 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include "simd.hpp"
+#include "bitmask.hpp"
+
+///////////////////////////
+// Raw-unit depth ranges //
+///////////////////////////
+
+// A z16 pixel is depth / depth_scale, and the scale differs between devices and settings (1 mm by default on
+// most, finer on some, configurable on others), so a threshold written in raw units is only right on the device
+// it was tuned on. Thresholds are kept in meters and converted once per stream; the kernels below then compare
+// raw pixels directly, eight to a register, with no per-pixel float conversion.
+
+// Nearest raw value to a distance in meters, clamped to what z16 can hold.
+inline uint16_t meters_to_raw(float meters, float depth_scale)
+{
+	return (uint16_t)std::max(0.0f, std::min(65535.0f, meters / depth_scale + 0.5f));
+}
+
+// The depths from near_m to far_m inclusive. Pixels without data (0) are never inside, whatever near_m is.
+class depth_range
+{
+	float near_m, far_m, scale;
+	uint16_t lo, hi;            // raw, lo >= 1; empty when hi < lo
+public:
+	depth_range(float near_m = 0, float far_m = 65535) : near_m(near_m), far_m(far_m), scale(), lo(1), hi(65535) {}
+
+	// Takes effect at the next configure(); setting the same range again keeps the conversion.
+	void set_meters(float near, float far)
+	{
+		if (near == near_m && far == far_m) return;
+		near_m = near;
+		far_m = far;
+		scale = 0;
+	}
+
+	// Converts to the raw units of a stream with this depth scale. Cheap when the scale is unchanged, so it can
+	// be called every frame.
+	void configure(float depth_scale)
+	{
+		if (depth_scale == scale) return;
+		scale = depth_scale;
+		lo = (uint16_t)std::max(1.0f, std::min(65535.0f, std::ceil(near_m / depth_scale)));
+		hi = (uint16_t)std::max(0.0f, std::min(65535.0f, std::floor(far_m / depth_scale)));
+	}
+
+	float get_near() const { return near_m; }
+	float get_far() const { return far_m; }
+	uint16_t get_lo() const { return lo; }
+	uint16_t get_hi() const { return hi; }
+	bool is_empty() const { return hi < lo; }
+	// (d - lo) <= (hi - lo), unsigned, is lo <= d <= hi
+	bool contains(uint16_t d) const { return !is_empty() && (uint16_t)(d - lo) <= (uint16_t)(hi - lo); }
+
+	// Pixels of depth[0, n) inside the range.
+	size_t count(const uint16_t * depth, size_t n) const
+	{
+		if (is_empty()) return 0;
+		size_t total = 0, i = 0;
+#ifdef MR_SSE2
+		const __m128i vlo = _mm_set1_epi16((short)lo), vrange = _mm_set1_epi16((short)(hi - lo)), ones = _mm_set1_epi16(1);
+		while (i + 8 <= n)
+		{
+			// 16-bit lane counters, flushed before they can overflow
+			__m128i acc = _mm_setzero_si128();
+			for (size_t end = std::min(n & ~(size_t)7, i + 8 * 65535); i < end; i += 8)
+			{
+				const __m128i out = mm_cmpgt_epu16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)(depth + i)), vlo), vrange);
+				acc = _mm_add_epi16(acc, _mm_andnot_si128(out, ones));
+			}
+			const __m128i zero = _mm_setzero_si128();
+			alignas(16) uint32_t lanes[4];
+			_mm_store_si128((__m128i *)lanes, _mm_add_epi32(_mm_unpacklo_epi16(acc, zero), _mm_unpackhi_epi16(acc, zero)));
+			total += (size_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+		}
+#endif
+		for (; i < n; ++i) total += contains(depth[i]);
+		return total;
+	}
+
+	// mask[i] = value where depth[i] is inside the range, 0 elsewhere.
+	void mask(const uint16_t * depth, size_t n, uint8_t * out, uint8_t value = 255) const
+	{
+		if (is_empty())
+		{
+			std::fill(out, out + n, 0);
+			return;
+		}
+		size_t i = 0;
+#ifdef MR_SSE2
+		const __m128i vlo = _mm_set1_epi16((short)lo), vrange = _mm_set1_epi16((short)(hi - lo)), vvalue = _mm_set1_epi8((char)value);
+		for (; i + 16 <= n; i += 16)
+		{
+			const __m128i a = mm_cmpgt_epu16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)(depth + i)), vlo), vrange);
+			const __m128i b = mm_cmpgt_epu16(_mm_sub_epi16(_mm_loadu_si128((const __m128i *)(depth + i + 8)), vlo), vrange);
+			_mm_storeu_si128((__m128i *)(out + i), _mm_andnot_si128(_mm_packs_epi16(a, b), vvalue));
+		}
+#endif
+		for (; i < n; ++i) out[i] = contains(depth[i]) ? value : 0;
+	}
+
+	// Sets the pixels outside the range to 0 (no data) in place; returns how many are left inside.
+	size_t clip(uint16_t * depth, size_t n) const
+	{
+		if (is_empty())
+		{
+			std::fill(depth, depth + n, 0);
+			return 0;
+		}
+		size_t total = 0, i = 0;
+#ifdef MR_SSE2
+		const __m128i vlo = _mm_set1_epi16((short)lo), vrange = _mm_set1_epi16((short)(hi - lo));
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m128i d = _mm_loadu_si128((const __m128i *)(depth + i));
+			const __m128i out = mm_cmpgt_epu16(_mm_sub_epi16(d, vlo), vrange);
+			_mm_storeu_si128((__m128i *)(depth + i), _mm_andnot_si128(out, d));
+			// one movemask bit pair per outside pixel
+			total += 8 - popcount64((uint16_t)_mm_movemask_epi8(out)) / 2;
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			if (contains(depth[i])) ++total;
+			else depth[i] = 0;
+		}
+		return total;
+	}
+};
@@ -0,0 +1,278 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "stream_controller.hpp"
+
+////////////////////
+// Device manager //
+////////////////////
+
+// What a camera reports about itself, read once per serial number and process.
+struct device_info
+{
+	std::string serial, name, firmware;
+	float depth_scale;
+	rs::extrinsics depth_to_color;
+	rs::format color_format;                   // the format modes was listed for
+	std::vector<stream_controller::mode> modes;
+};
+
+enum class device_status { streaming, recovering };
+
+// Opens every camera of a context at once and keeps them streaming. Startup runs one thread per camera, so the
+// rig is up in the time of its slowest camera rather than the sum of all of them; each camera's modes and
+// calibration are cached by serial number, so opening or restarting it again skips the queries.
+//
+// Frames are fetched with next_frame(), one thread per camera (or one for all of them). A camera that throws,
+// or whose frames stop arriving or stop advancing in time for stall_ms, is marked recovering and restarted from
+// that same call with increasing back-off, while the other cameras carry on. librealsense 1.x can't enumerate
+// devices plugged in after the context was made, so recovery restarts the device it already has; a camera that
+// drops off USB comes back once it reappears under the same handle.
+class device_manager
+{
+	struct entry
+	{
+		rs::device * dev;
+		device_info info;
+		stream_controller controller;
+		std::atomic<device_status> status;
+		std::atomic<unsigned long long> recoveries;
+		bool started;                          // came up once, so a restart in its mode will do
+		// owned by the thread calling next_frame for the camera
+		int last_timestamp;
+		std::chrono::steady_clock::time_point last_frame, retry_at;
+		int backoff_ms;
+		entry() : dev(), status(device_status::recovering), recoveries(0), started(), last_timestamp(-1), backoff_ms(0) {}
+	};
+
+	std::vector<std::unique_ptr<entry>> devices;
+	int stall_ms;
+	// what open() was asked for, to finish cameras that failed to come up then
+	rs::format color_format;
+	std::function<void(int, stream_controller &)> setup;
+	int width, height, framerate;
+
+	static const int MIN_BACKOFF_MS = 250, MAX_BACKOFF_MS = 5000;
+
+	static std::mutex & cache_mutex()
+	{
+		static std::mutex m;
+		return m;
+	}
+	static std::map<std::string, device_info> & cache()
+	{
+		static std::map<std::string, device_info> c;
+		return c;
+	}
+
+	// Reads the camera's description, from the cache when this serial has been seen with this color format.
+	static device_info describe(rs::device & dev, stream_controller & controller, rs::format color)
+	{
+		const std::string serial = dev.get_serial();
+		{
+			std::lock_guard<std::mutex> lock(cache_mutex());
+			auto cached = cache().find(serial);
+			if (cached != cache().end() && cached->second.color_format == color)
+			{
+				controller.set_modes(cached->second.modes, color);
+				return cached->second;
+			}
+		}
+
+		device_info info;
+		info.serial = serial;
+		info.name = dev.get_name();
+		info.firmware = dev.get_firmware_version();
+		info.depth_scale = dev.get_depth_scale();
+		info.depth_to_color = dev.get_extrinsics(rs::stream::depth, rs::stream::color);
+		info.color_format = color;
+		controller.enumerate(dev, color);
+		info.modes = controller.get_modes();
+
+		std::lock_guard<std::mutex> lock(cache_mutex());
+		cache()[serial] = info;
+		return info;
+	}
+
+	// First start of camera i: describe it, let setup configure the controller, and start streaming.
+	void start(int i)
+	{
+		entry & e = *devices[i];
+		e.info = describe(*e.dev, e.controller, color_format);
+		if (setup) setup(i, e.controller);
+		if (!e.controller.start(*e.dev, width, height, framerate))
+		{
+			e.dev->enable_stream(rs::stream::depth, rs::preset::best_quality);
+			if (color_format != rs::format::any) e.dev->enable_stream(rs::stream::color, rs::preset::best_quality);
+			e.dev->start();
+		}
+		e.started = true;
+		e.status = device_status::streaming;
+		e.last_frame = std::chrono::steady_clock::now();
+	}
+
+	void lost(entry & e)
+	{
+		e.status = device_status::recovering;
+		e.backoff_ms = MIN_BACKOFF_MS;
+		e.retry_at = std::chrono::steady_clock::now();
+	}
+
+	// One restart attempt; on failure the next one waits twice as long.
+	bool recover(int i)
+	{
+		entry & e = *devices[i];
+		const auto now = std::chrono::steady_clock::now();
+		if (now < e.retry_at) return false;
+		try
+		{
+			if (e.dev->is_streaming()) e.dev->stop();
+		}
+		catch (const rs::error &) {}
+		try
+		{
+			if (!e.started)
+			{
+				start(i);
+				return true;
+			}
+			e.controller.restart(*e.dev);
+			e.status = device_status::streaming;
+			e.last_frame = std::chrono::steady_clock::now();
+			e.last_timestamp = -1;
+			++e.recoveries;
+			return true;
+		}
+		catch (const rs::error &)
+		{
+			e.retry_at = now + std::chrono::milliseconds(e.backoff_ms);
+			e.backoff_ms = std::min(e.backoff_ms * 2, MAX_BACKOFF_MS);
+			return false;
+		}
+	}
+public:
+	device_manager(int stall = 1000) : stall_ms(stall), color_format(rs::format::any), width(), height(), framerate() {}
+	device_manager(const device_manager &) = delete;
+	device_manager & operator=(const device_manager &) = delete;
+
+	// Opens up to max_devices cameras (0 for all) in parallel and starts each in the mode nearest to the one given,
+	// or the best its controller allows with 0s. setup runs first, on the camera's startup thread, to set the
+	// controller's profiles and budget. Color is streamed in color, or not at all with rs::format::any. Cameras
+	// without a usable mode list fall back to the device's preferred settings. Returns how many are streaming;
+	// the others are retried by next_frame().
+	int open(rs::context & ctx, rs::format color, const std::function<void(int, stream_controller &)> & configure, int max_devices = 0,
+		int mode_width = 0, int mode_height = 0, int mode_framerate = 0)
+	{
+		color_format = color;
+		setup = configure;
+		width = mode_width;
+		height = mode_height;
+		framerate = mode_framerate;
+		const int count = max_devices > 0 ? std::min(max_devices, ctx.get_device_count()) : ctx.get_device_count();
+		const size_t first = devices.size();
+		for (int i = 0; i < count; ++i)
+		{
+			devices.emplace_back(new entry);
+			devices.back()->dev = ctx.get_device(i);
+		}
+
+		std::vector<std::thread> threads;
+		for (size_t i = first; i < devices.size(); ++i)
+		{
+			threads.emplace_back([this, i]()
+			{
+				try
+				{
+					start((int)i);
+				}
+				catch (const rs::error &)
+				{
+					lost(*devices[i]);
+				}
+			});
+		}
+		for (auto & t : threads) t.join();
+
+		int streaming = 0;
+		for (auto & e : devices) streaming += e->status == device_status::streaming;
+		return streaming;
+	}
+
+	// Waits up to timeout_ms for a new frame set from camera i and returns whether there is one; the frames are
+	// then read from get_device(i) as usual. Applies pending mode switches first (restarted tells whether one
+	// was), and handles stalls and recovery. Only one thread may call it per camera.
+	bool next_frame(int i, int timeout_ms, bool * restarted = nullptr)
+	{
+		entry & e = *devices[i];
+		if (restarted) *restarted = false;
+		const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+		if (e.status != device_status::streaming)
+		{
+			if (!recover(i))
+			{
+				std::this_thread::sleep_until(std::min(deadline, e.retry_at));
+				return false;
+			}
+			if (restarted) *restarted = true;
+		}
+
+		try
+		{
+			// a mode switch can take a while, which is not a stall
+			if (e.controller.apply(*e.dev))
+			{
+				e.last_frame = std::chrono::steady_clock::now();
+				if (restarted) *restarted = true;
+			}
+			for (;;)
+			{
+				// A frame whose timestamp hasn't moved is the firmware repeating itself, not a new frame.
+				if (e.dev->poll_for_frames())
+				{
+					const int timestamp = e.dev->get_frame_timestamp(rs::stream::depth);
+					if (timestamp != e.last_timestamp)
+					{
+						e.last_timestamp = timestamp;
+						e.last_frame = std::chrono::steady_clock::now();
+						return true;
+					}
+				}
+				const auto now = std::chrono::steady_clock::now();
+				if (now - e.last_frame > std::chrono::milliseconds(stall_ms))
+				{
+					lost(e);
+					return false;
+				}
+				if (now >= deadline) return false;
+				std::this_thread::sleep_for(std::chrono::microseconds(500));
+			}
+		}
+		catch (const rs::error &)
+		{
+			lost(e);
+			return false;
+		}
+	}
+
+	// For device calls made outside next_frame that threw: treats the camera as lost so next_frame recovers it.
+	// Call it from the thread that calls next_frame for the camera.
+	void report_error(int i) { lost(*devices[i]); }
+
+	int get_device_count() const { return (int)devices.size(); }
+	rs::device * get_device(int i) const { return devices[i]->dev; }
+	const device_info & get_info(int i) const { return devices[i]->info; }
+	stream_controller & get_controller(int i) { return devices[i]->controller; }
+	device_status get_status(int i) const { return devices[i]->status; }
+	bool is_streaming(int i) const { return devices[i]->status == device_status::streaming; }
+	unsigned long long get_recovery_count(int i) const { return devices[i]->recoveries; }
+};
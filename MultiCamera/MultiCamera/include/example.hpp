@@ -6,6 +6,7 @@
 
 #include <sstream>
 #include <vector>
+#include "trace.hpp"
 
 inline void make_depth_histogram(uint8_t rgb_image[640*480*3], const uint16_t depth_image[], int width, int height)
 {
@@ -70,6 +71,7 @@ public:
 
     void upload(const void * data, int width, int height, rs::format format)
     {
+        MR_TRACE_SCOPE("texture_buffer::upload");
         // If the frame timestamp has changed since the last time show(...) was called, re-upload the texture
         if(!texture) glGenTextures(1, &texture);
         glBindTexture(GL_TEXTURE_2D, texture);
@@ -0,0 +1,177 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include "spsc_ring.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+////////////////////////////////
+// Multi-device frame syncing //
+////////////////////////////////
+
+// One captured depth+color frame, copied out of the device so the capture thread can move on.
+struct device_frame
+{
+	int timestamp;       // device timestamp in ms, as reported by get_frame_timestamp
+	double host_time;    // the same instant on the host clock, in ms
+	int depth_width, depth_height;
+	int color_width, color_height;
+	// calibration the frame was taken with, so the consumer never has to ask a device that may be restarting
+	rs::intrinsics depth_intrin, color_intrin;
+	rs::extrinsics depth_to_color;               // this and color_intrin zeroed without color
+	float depth_scale;
+	std::vector<uint16_t> depth;
+	std::vector<uint8_t> color;
+};
+
+// Collects frames from several devices, each on its own capture thread, and hands the consumer sets of
+// frames that were captured within a tolerance of each other.
+//
+// Every device timestamps frames with its own clock, so timestamps are first mapped to the host clock. The
+// offset between the two is the smallest (host arrival - device timestamp) seen so far, i.e. the frame that
+// arrived with the least transport delay; it creeps up slowly so that clock drift is followed.
+class frame_synchronizer
+{
+public:
+	static const size_t RING_SIZE = 4;
+private:
+	struct channel
+	{
+		spsc_ring<device_frame, RING_SIZE> ring;
+		std::atomic<uint64_t> dropped;  // ring was full when a frame arrived (consumer too slow)
+		uint64_t unmatched;             // discarded by the consumer because no partner frame was close enough
+		double offset;                  // host ms - device ms, touched only by the capture thread
+		bool has_offset;
+		bool enabled;                   // consumer side: whether next() waits for this device
+		channel() : dropped(0), unmatched(0), offset(0), has_offset(false), enabled(true) {}
+	};
+
+	std::vector<std::unique_ptr<channel>> channels;
+	std::vector<device_frame *> current;
+	double tolerance;
+	double last_skew, skew_sum;
+	uint64_t matched;
+	const std::chrono::steady_clock::time_point epoch;
+public:
+	frame_synchronizer(int devices, double tolerance_ms = 8)
+		: current(devices), tolerance(tolerance_ms), last_skew(0), skew_sum(0), matched(0), epoch(std::chrono::steady_clock::now())
+	{
+		for (int i = 0; i < devices; ++i) channels.emplace_back(new channel);
+	}
+
+	int get_device_count() const { return (int)channels.size(); }
+	void set_tolerance(double ms) { tolerance = ms; }
+
+	// Current time on the host clock that device_frame::host_time is expressed in.
+	double now() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - epoch).count(); }
+
+	// Producer side: call from device's capture thread right after wait_for_frames(). Returns false if the
+	// frame had to be dropped because the consumer has fallen RING_SIZE frames behind.
+	bool push(int device, const rs::device & camera)
+	{
+		channel & c = *channels[device];
+		const int timestamp = camera.get_frame_timestamp(rs::stream::depth);
+
+		const double sample = now() - timestamp;
+		c.offset = c.has_offset ? std::min(c.offset + 0.01, sample) : sample;
+		c.has_offset = true;
+
+		device_frame * f = c.ring.acquire_write();
+		if (!f)
+		{
+			c.dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+
+		f->timestamp = timestamp;
+		f->host_time = timestamp + c.offset;
+		f->depth_width = camera.get_stream_width(rs::stream::depth);
+		f->depth_height = camera.get_stream_height(rs::stream::depth);
+		f->depth_intrin = camera.get_stream_intrinsics(rs::stream::depth);
+		f->depth_scale = camera.get_depth_scale();
+		const uint16_t * depth = (const uint16_t *)camera.get_frame_data(rs::stream::depth);
+		f->depth.assign(depth, depth + f->depth_width * f->depth_height);
+
+		if (camera.is_stream_enabled(rs::stream::color))
+		{
+			f->color_width = camera.get_stream_width(rs::stream::color);
+			f->color_height = camera.get_stream_height(rs::stream::color);
+			f->color_intrin = camera.get_stream_intrinsics(rs::stream::color);
+			f->depth_to_color = camera.get_extrinsics(rs::stream::depth, rs::stream::color);
+			const uint8_t * color = (const uint8_t *)camera.get_frame_data(rs::stream::color);
+			f->color.assign(color, color + f->color_width * f->color_height * 3);
+		}
+		else
+		{
+			f->color_width = f->color_height = 0;
+			f->color_intrin = rs::intrinsics();
+			f->depth_to_color = rs::extrinsics();
+			f->color.clear();
+		}
+
+		c.ring.commit_write();
+		return true;
+	}
+
+	// Consumer side: a disabled device, e.g. one that is being restarted, is left out of the matching and gets a
+	// null frame from next() until it is enabled again.
+	void set_enabled(int device, bool enabled) { channels[device]->enabled = enabled; }
+
+	// Consumer side: returns true and fills frames (one per device) once every enabled device has a frame within
+	// the tolerance of the newest one. Older frames that can no longer be matched are discarded. The frames stay
+	// valid, and may be modified in place, until release().
+	bool next(std::vector<device_frame *> & frames)
+	{
+		for (;;)
+		{
+			double newest = -1e300, oldest = 1e300;
+			bool any = false;
+			for (size_t i = 0; i < channels.size(); ++i)
+			{
+				current[i] = nullptr;
+				if (!channels[i]->enabled) continue;
+				current[i] = channels[i]->ring.front();
+				if (!current[i]) return false;
+				any = true;
+				newest = std::max(newest, current[i]->host_time);
+				oldest = std::min(oldest, current[i]->host_time);
+			}
+
+			if (!any) return false;
+			if (newest - oldest <= tolerance)
+			{
+				last_skew = newest - oldest;
+				skew_sum += last_skew;
+				++matched;
+				frames = current;
+				return true;
+			}
+
+			// Something is too old to pair with the newest frame: drop it and look again.
+			for (size_t i = 0; i < channels.size(); ++i)
+			{
+				if (current[i] && current[i]->host_time < newest - tolerance)
+				{
+					channels[i]->ring.pop();
+					++channels[i]->unmatched;
+				}
+			}
+		}
+	}
+
+	void release()
+	{
+		for (size_t i = 0; i < channels.size(); ++i) if (current[i]) channels[i]->ring.pop();
+	}
+
+	double get_last_skew() const { return last_skew; }
+	double get_mean_skew() const { return matched ? skew_sum / matched : 0; }
+	uint64_t get_matched_count() const { return matched; }
+	// frames of the device waiting behind the one the consumer holds
+	int get_queued_count(int device) const { return std::max(0, (int)channels[device]->ring.size() - 1); }
+	uint64_t get_dropped_count(int device) const { return channels[device]->dropped.load(std::memory_order_relaxed); }
+	uint64_t get_unmatched_count(int device) const { return channels[device]->unmatched; }
+};
@@ -0,0 +1,175 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include "simd.hpp"
+#include "lens.hpp"
+
+///////////////////////////////
+// Multi-camera cloud fusion //
+///////////////////////////////
+
+inline rs::extrinsics identity_pose()
+{
+	rs::extrinsics pose = {};
+	pose.rotation[0] = pose.rotation[4] = pose.rotation[8] = 1;
+	return pose;
+}
+
+// Reads the pose of the camera with the given serial number from a text file with one camera per line:
+//     <serial> <rotation, 9 values, column-major like rs::extrinsics> <translation x y z in meters>
+// Lines starting with '#' are ignored. Returns false and leaves pose untouched if the camera is not listed.
+inline bool load_camera_pose(const char * path, const char * serial, rs::extrinsics & pose)
+{
+	FILE * file = fopen(path, "r");
+	if (!file) return false;
+
+	char line[512];
+	bool found = false;
+	while (!found && fgets(line, sizeof(line), file))
+	{
+		char name[128];
+		rs::extrinsics p;
+		if (line[0] == '#') continue;
+		if (sscanf(line, "%127s %f %f %f %f %f %f %f %f %f %f %f %f", name,
+			&p.rotation[0], &p.rotation[1], &p.rotation[2], &p.rotation[3], &p.rotation[4], &p.rotation[5],
+			&p.rotation[6], &p.rotation[7], &p.rotation[8], &p.translation[0], &p.translation[1], &p.translation[2]) != 13) continue;
+		if (strcmp(name, serial) == 0)
+		{
+			pose = p;
+			found = true;
+		}
+	}
+	fclose(file);
+	return found;
+}
+
+// Merges the depth frames of several cameras into one colored point cloud in a shared world frame.
+// Call begin_frame() once per frame, add_camera_frame() for every camera that has new data, then hand
+// get_points()/get_colors() to the renderer or gesture logic. The buffers only grow, so in steady state
+// no allocation happens per frame.
+class cloud_fusion
+{
+	struct camera
+	{
+		rs::extrinsics pose;
+		rs::intrinsics intrin;
+		std::vector<float> ray_x, ray_y; // deprojection of every pixel at 1 m
+	};
+
+	std::vector<camera> cameras;
+	std::vector<float> xs, ys, zs;       // camera-space points of the frame being added, struct-of-arrays for SIMD
+	std::vector<rs::float3> points;
+	std::vector<uint8_t> colors;
+	size_t count;
+
+	static void update_rays(camera & cam, const rs::intrinsics & intrin)
+	{
+		if (cam.intrin == intrin && !cam.ray_x.empty()) return;
+		cam.intrin = intrin;
+		cam.ray_x.resize(intrin.width * intrin.height);
+		cam.ray_y.resize(intrin.width * intrin.height);
+		get_lens_kernels(intrin.model()).rays(intrin, cam.ray_x.data(), cam.ray_y.data());
+	}
+
+	// world = R * p + t for n points, four at a time.
+	static void transform_points(const rs::extrinsics & pose, const float * x, const float * y, const float * z, size_t n, rs::float3 * out)
+	{
+		const float * r = pose.rotation, * t = pose.translation;
+		size_t i = 0;
+#ifdef MR_SSE2
+		const __m128 r0 = _mm_set1_ps(r[0]), r1 = _mm_set1_ps(r[1]), r2 = _mm_set1_ps(r[2]);
+		const __m128 r3 = _mm_set1_ps(r[3]), r4 = _mm_set1_ps(r[4]), r5 = _mm_set1_ps(r[5]);
+		const __m128 r6 = _mm_set1_ps(r[6]), r7 = _mm_set1_ps(r[7]), r8 = _mm_set1_ps(r[8]);
+		const __m128 t0 = _mm_set1_ps(t[0]), t1 = _mm_set1_ps(t[1]), t2 = _mm_set1_ps(t[2]);
+		for (; i + 4 <= n; i += 4)
+		{
+			const __m128 px = _mm_loadu_ps(x + i), py = _mm_loadu_ps(y + i), pz = _mm_loadu_ps(z + i);
+			__m128 wx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, px), _mm_mul_ps(r3, py)), _mm_add_ps(_mm_mul_ps(r6, pz), t0));
+			__m128 wy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r1, px), _mm_mul_ps(r4, py)), _mm_add_ps(_mm_mul_ps(r7, pz), t1));
+			__m128 wz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r2, px), _mm_mul_ps(r5, py)), _mm_add_ps(_mm_mul_ps(r8, pz), t2));
+			__m128 ww = _mm_setzero_ps();
+
+			// Back to xyz triples: after the transpose each register holds one point plus a padding lane,
+			// and the overlapping stores let the next point overwrite that padding.
+			_MM_TRANSPOSE4_PS(wx, wy, wz, ww);
+			float * dst = &out[i].x;
+			_mm_storeu_ps(dst, wx);
+			_mm_storeu_ps(dst + 3, wy);
+			_mm_storeu_ps(dst + 6, wz);
+			_mm_storel_pi((__m64 *)(dst + 9), ww);
+			_mm_store_ss(dst + 11, _mm_movehl_ps(ww, ww));
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			out[i].x = r[0] * x[i] + r[3] * y[i] + r[6] * z[i] + t[0];
+			out[i].y = r[1] * x[i] + r[4] * y[i] + r[7] * z[i] + t[1];
+			out[i].z = r[2] * x[i] + r[5] * y[i] + r[8] * z[i] + t[2];
+		}
+	}
+public:
+	cloud_fusion() : count() {}
+
+	void set_camera_count(int n)
+	{
+		camera c = camera();
+		c.pose = identity_pose();
+		cameras.resize(n, c);
+	}
+	int get_camera_count() const { return (int)cameras.size(); }
+
+	void set_pose(int cam, const rs::extrinsics & pose) { cameras[cam].pose = pose; }
+	const rs::extrinsics & get_pose(int cam) const { return cameras[cam].pose; }
+
+	void begin_frame() { count = 0; }
+
+	// Deprojects every valid depth pixel, colors it from the rgb8 color image through color_index (the
+	// per-pixel map built by registration; white where it is -1), and appends it to the merged cloud in world
+	// space. color may be null for an uncolored cloud.
+	void add_camera_frame(int cam, const uint16_t * depth, const rs::intrinsics & depth_intrin, float scale,
+		const uint8_t * color, const int32_t * color_index)
+	{
+		camera & c = cameras[cam];
+		update_rays(c, depth_intrin);
+
+		const size_t pixels = depth_intrin.width * depth_intrin.height;
+		if (xs.size() < pixels)
+		{
+			xs.resize(pixels);
+			ys.resize(pixels);
+			zs.resize(pixels);
+		}
+		if (points.size() < count + pixels)
+		{
+			points.resize(count + pixels);
+			colors.resize((count + pixels) * 3);
+		}
+
+		size_t n = 0;
+		uint8_t * rgb = colors.data() + count * 3;
+		for (size_t i = 0; i < pixels; ++i)
+		{
+			if (!depth[i]) continue;
+			const float z = depth[i] * scale;
+			xs[n] = c.ray_x[i] * z;
+			ys[n] = c.ray_y[i] * z;
+			zs[n] = z;
+
+			uint8_t * dst = rgb + n * 3;
+			if (color && color_index[i] >= 0) memcpy(dst, color + color_index[i] * 3, 3);
+			else dst[0] = dst[1] = dst[2] = 255;
+			++n;
+		}
+
+		transform_points(c.pose, xs.data(), ys.data(), zs.data(), n, points.data() + count);
+		count += n;
+	}
+
+	size_t size() const { return count; }
+	const rs::float3 * get_points() const { return points.data(); }
+	const uint8_t * get_colors() const { return colors.data(); }
+};
@@ -0,0 +1,150 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <vector>
+
+//////////////////////////////////
+// Time-division laser schedule //
+//////////////////////////////////
+
+// Owns the IR projector of every camera in the rig and lights one of them at a time, so overlapping cameras
+// don't wash out each other's pattern. Each camera gets a time slot in turn; a camera that keeps reporting
+// activity gets a longer slot, and when only one camera sees anything it keeps the projector and the others
+// just get a short probe slot now and then. Frames captured while a projector is still settling after a
+// switch are flagged as unusable so callers can skip them instead of reading garbage depth.
+//
+// All times are host milliseconds in one timebase, e.g. frame_synchronizer::now() and device_frame::host_time.
+class laser_scheduler
+{
+	struct camera
+	{
+		rs::device * dev;
+		rs::option option;
+		double on_value, off_value;
+		bool controllable;
+		double lit_since, lit_until;   // current (or last) lit interval
+		double activity;               // smoothed 0-1 share of recent usable frames that saw something
+		int usable_frames;
+		double fps;
+	};
+
+	std::vector<camera> cameras;
+	int lit;
+	double slot_start, fps_window_start;
+	double probe_slot, max_slot, settle;
+
+	void set_projector(camera & c, bool on)
+	{
+		if (!c.controllable) return;
+		try
+		{
+			c.dev->set_option(c.option, on ? c.on_value : c.off_value);
+		}
+		catch (const rs::error &)
+		{
+			// The camera dropped off the bus; the schedule carries on without it until it is back.
+		}
+	}
+
+	double slot_length(int i) const
+	{
+		bool others_active = false;
+		for (int j = 0; j < (int)cameras.size(); ++j)
+			if (j != i && cameras[j].activity > 0.5) others_active = true;
+
+		// Sole active camera: hold the projector as long as allowed so no time is lost to settling.
+		if (cameras[i].activity > 0.5 && !others_active) return max_slot;
+		return probe_slot + (max_slot - probe_slot) * cameras[i].activity * 0.5;
+	}
+
+	void switch_to(int next, double now)
+	{
+		if (next == lit) return;
+		if (lit >= 0)
+		{
+			set_projector(cameras[lit], false);
+			cameras[lit].lit_until = now;
+		}
+		set_projector(cameras[next], true);
+		cameras[next].lit_since = now;
+		cameras[next].lit_until = 1e300;
+		lit = next;
+	}
+public:
+	// probe_ms is the slot an idle camera gets, max_ms the longest slot, settle_ms how long a projector
+	// needs after being switched on before depth can be trusted.
+	laser_scheduler(double probe_ms = 150, double max_ms = 1000, double settle_ms = 40)
+		: lit(-1), slot_start(0), fps_window_start(0), probe_slot(probe_ms), max_slot(max_ms), settle(settle_ms) {}
+
+	// Picks the projector control the device supports: laser power on F200/SR300, emitter on/off on R200.
+	int add_device(rs::device * dev)
+	{
+		camera c = { dev, rs::option::f200_laser_power, 15, 0, false, 0, 0, 0, 0, 0 };
+		if (dev->supports_option(rs::option::f200_laser_power)) c.controllable = true;
+		else if (dev->supports_option(rs::option::r200_emitter_enabled))
+		{
+			c.option = rs::option::r200_emitter_enabled;
+			c.on_value = 1;
+			c.controllable = true;
+		}
+		set_projector(c, false);
+		cameras.push_back(c);
+		return (int)cameras.size() - 1;
+	}
+
+	// Lights the first camera. Call after all devices are added.
+	void start(double now)
+	{
+		if (cameras.empty()) return;
+		slot_start = fps_window_start = now;
+		switch_to(0, now);
+	}
+
+	// Whether a frame the camera captured at frame_time had its projector on and settled.
+	bool is_usable(int i, double frame_time) const
+	{
+		return frame_time >= cameras[i].lit_since + settle && frame_time < cameras[i].lit_until;
+	}
+
+	// Report what a usable frame showed; drives how long each camera's slot is.
+	void report(int i, bool active)
+	{
+		camera & c = cameras[i];
+		c.activity += ((active ? 1.0 : 0.0) - c.activity) * 0.2;
+		++c.usable_frames;
+	}
+
+	// Call once per processed frame set; hands the projector on when the current slot is over.
+	void update(double now)
+	{
+		if (lit < 0) return;
+
+		if (now - fps_window_start >= 1000)
+		{
+			for (auto & c : cameras)
+			{
+				c.fps = c.usable_frames * 1000.0 / (now - fps_window_start);
+				c.usable_frames = 0;
+			}
+			fps_window_start = now;
+		}
+
+		// a single camera keeps its projector, but still gets its frame rate measured
+		if (cameras.size() < 2 || now - slot_start < slot_length(lit)) return;
+
+		// Sole active camera keeps the projector unless another camera is overdue for a probe.
+		int next = (lit + 1) % cameras.size();
+		bool others_active = false;
+		for (int j = 0; j < (int)cameras.size(); ++j)
+			if (j != lit && cameras[j].activity > 0.5) others_active = true;
+		if (cameras[lit].activity > 0.5 && !others_active && now - cameras[next].lit_until < 4 * max_slot) next = lit;
+
+		switch_to(next, now);
+		slot_start = now;
+	}
+
+	int get_lit_camera() const { return lit; }
+	// Frames per second that were lit, settled and processed, over the last second.
+	double get_effective_fps(int i) const { return cameras[i].fps; }
+	double get_activity(int i) const { return cameras[i].activity; }
+};
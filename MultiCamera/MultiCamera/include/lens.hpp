@@ -0,0 +1,191 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <cstddef>
+#ifdef MR_BENCHMARK
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#endif
+
+//////////////////////////////////////
+// Distortion-specialized lens math //
+//////////////////////////////////////
+
+// The same mapping between pixels and camera space as rs::intrinsics::project/deproject (rsutil.h), with the
+// distortion model a template argument instead of a per-pixel check of intrin.model. The model tests below are
+// on a constant and fold away, so each instantiation is straight-line code, and the batch loops have no branches
+// for the compiler to keep them from vectorizing. Pick the instantiation once per stream with get_lens_kernels().
+//
+// As in rsutil.h, projection models none and modified Brown-Conrady and deprojection none and inverse
+// Brown-Conrady. The other model is applied as none, which is what rsutil.h does in release builds (debug builds
+// assert there).
+
+template<rs::distortion M> inline rs::float2 lens_project(const rs::intrinsics & in, const rs::float3 & p)
+{
+	float x = p.x / p.z, y = p.y / p.z;
+	if (M == rs::distortion::modified_brown_conrady)
+	{
+		const float * k = in.coeffs;
+		const float r2 = x * x + y * y;
+		const float f = 1 + k[0] * r2 + k[1] * r2 * r2 + k[4] * r2 * r2 * r2;
+		x *= f;
+		y *= f;
+		const float dx = x + 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+		const float dy = y + 2 * k[3] * x * y + k[2] * (r2 + 2 * y * y);
+		x = dx;
+		y = dy;
+	}
+	return { x * in.fx + in.ppx, y * in.fy + in.ppy };
+}
+
+// The ray through pixel (u, v) at z = 1; multiply by the depth for the point.
+template<rs::distortion M> inline rs::float2 lens_ray(const rs::intrinsics & in, float u, float v)
+{
+	float x = (u - in.ppx) / in.fx, y = (v - in.ppy) / in.fy;
+	if (M == rs::distortion::inverse_brown_conrady)
+	{
+		const float * k = in.coeffs;
+		const float r2 = x * x + y * y;
+		const float f = 1 + k[0] * r2 + k[1] * r2 * r2 + k[4] * r2 * r2 * r2;
+		const float ux = x * f + 2 * k[2] * x * y + k[3] * (r2 + 2 * x * x);
+		const float uy = y * f + 2 * k[3] * x * y + k[2] * (r2 + 2 * y * y);
+		x = ux;
+		y = uy;
+	}
+	return { x, y };
+}
+
+template<rs::distortion M> inline rs::float3 lens_deproject(const rs::intrinsics & in, const rs::float2 & pixel, float depth)
+{
+	const rs::float2 r = lens_ray<M>(in, pixel.x, pixel.y);
+	return { r.x * depth, r.y * depth, depth };
+}
+
+// Struct-of-arrays batches, n points each. Points with z <= 0 project to garbage rather than being skipped.
+template<rs::distortion M> void lens_deproject_n(const rs::intrinsics & in, const float * u, const float * v, const float * z, size_t n, float * x, float * y)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		const rs::float2 r = lens_ray<M>(in, u[i], v[i]);
+		x[i] = r.x * z[i];
+		y[i] = r.y * z[i];
+	}
+}
+
+template<rs::distortion M> void lens_project_n(const rs::intrinsics & in, const float * x, const float * y, const float * z, size_t n, float * u, float * v)
+{
+	for (size_t i = 0; i < n; ++i)
+	{
+		const rs::float2 p = lens_project<M>(in, { x[i], y[i], z[i] });
+		u[i] = p.x;
+		v[i] = p.y;
+	}
+}
+
+// The ray of every pixel at 1 m, row by row: width * height entries each.
+template<rs::distortion M> void lens_rays(const rs::intrinsics & in, float * ray_x, float * ray_y)
+{
+	for (int y = 0, i = 0; y < in.height; ++y)
+	{
+		for (int x = 0; x < in.width; ++x, ++i)
+		{
+			const rs::float2 r = lens_ray<M>(in, (float)x, (float)y);
+			ray_x[i] = r.x;
+			ray_y[i] = r.y;
+		}
+	}
+}
+
+// One stream's kernels, for code that only learns the model at run time.
+struct lens_kernels
+{
+	void (*deproject_n)(const rs::intrinsics &, const float *, const float *, const float *, size_t, float *, float *);
+	void (*project_n)(const rs::intrinsics &, const float *, const float *, const float *, size_t, float *, float *);
+	void (*rays)(const rs::intrinsics &, float *, float *);
+};
+
+template<rs::distortion M> const lens_kernels & lens_kernels_for()
+{
+	static const lens_kernels k = { &lens_deproject_n<M>, &lens_project_n<M>, &lens_rays<M> };
+	return k;
+}
+
+inline const lens_kernels & get_lens_kernels(rs::distortion model)
+{
+	switch (model)
+	{
+	case rs::distortion::modified_brown_conrady: return lens_kernels_for<rs::distortion::modified_brown_conrady>();
+	case rs::distortion::inverse_brown_conrady: return lens_kernels_for<rs::distortion::inverse_brown_conrady>();
+	default: return lens_kernels_for<rs::distortion::none>();
+	}
+}
+
+#ifdef MR_BENCHMARK
+// Times the generic rs::intrinsics path against the kernels for in's own model over every pixel of the image,
+// repeats times, and prints ms per image and the largest difference between the two. With in's model, the
+// direction rsutil.h does not support (projecting with inverse Brown-Conrady, deprojecting with modified) is
+// skipped, as the generic path asserts there in debug builds.
+inline void lens_benchmark(const rs::intrinsics & in, int repeats = 50)
+{
+	typedef std::chrono::steady_clock clock;
+	const size_t n = (size_t)in.width * in.height;
+	std::vector<float> u(n), v(n), z(n), x(n), y(n), gx(n), gy(n);
+	for (int py = 0, i = 0; py < in.height; ++py)
+	{
+		for (int px = 0; px < in.width; ++px, ++i)
+		{
+			u[i] = (float)px;
+			v[i] = (float)py;
+			z[i] = 0.5f + 0.001f * (i % 1000);
+		}
+	}
+	const lens_kernels & k = get_lens_kernels(in.model());
+	const auto ms = [&](clock::time_point t0) { return std::chrono::duration<double, std::milli>(clock::now() - t0).count() / repeats; };
+	float error = 0;
+
+	printf("Lens kernels, %dx%d, model %d\n", in.width, in.height, (int)in.model());
+	if (in.model() != rs::distortion::modified_brown_conrady)
+	{
+		auto t0 = clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				const rs::float3 p = in.deproject({ u[i], v[i] }, z[i]);
+				gx[i] = p.x;
+				gy[i] = p.y;
+			}
+		}
+		const double generic = ms(t0);
+		t0 = clock::now();
+		for (int r = 0; r < repeats; ++r) k.deproject_n(in, u.data(), v.data(), z.data(), n, x.data(), y.data());
+		const double specialized = ms(t0);
+		for (size_t i = 0; i < n; ++i) error = std::max(error, std::max(std::fabs(x[i] - gx[i]), std::fabs(y[i] - gy[i])));
+		printf("    deproject: generic %.3f ms, specialized %.3f ms, max difference %g m\n", generic, specialized, error);
+	}
+	if (in.model() != rs::distortion::inverse_brown_conrady)
+	{
+		// project the deprojected points back, so both paths see points inside the view
+		k.deproject_n(in, u.data(), v.data(), z.data(), n, x.data(), y.data());
+		auto t0 = clock::now();
+		for (int r = 0; r < repeats; ++r)
+		{
+			for (size_t i = 0; i < n; ++i)
+			{
+				const rs::float2 p = in.project({ x[i], y[i], z[i] });
+				gx[i] = p.x;
+				gy[i] = p.y;
+			}
+		}
+		const double generic = ms(t0);
+		t0 = clock::now();
+		for (int r = 0; r < repeats; ++r) k.project_n(in, x.data(), y.data(), z.data(), n, u.data(), v.data());
+		const double specialized = ms(t0);
+		error = 0;
+		for (size_t i = 0; i < n; ++i) error = std::max(error, std::max(std::fabs(u[i] - gx[i]), std::fabs(v[i] - gy[i])));
+		printf("    project: generic %.3f ms, specialized %.3f ms, max difference %g px\n", generic, specialized, error);
+	}
+}
+#endif
@@ -0,0 +1,106 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "simd.hpp"
+
+/////////////////
+// Motion gate //
+/////////////////
+
+// Decides whether a depth frame differs enough from the last processed one to be worth processing. It sums
+// absolute differences over every row_step-th row against a copy of that frame: a frame above the threshold is
+// processed at once, so motion is never picked up late, while frames of a still scene can reuse the previous
+// result. A frame is still processed every refresh_interval frames, and the comparison is always against the
+// last processed frame, so slow drift adds up and eventually passes the gate too.
+//
+// Depth noise would otherwise swamp a small moving hand, so each pixel's difference is reduced by a noise floor
+// and capped, and pixels without data in either frame are left out. The threshold is the mean of what remains
+// per compared pixel.
+class motion_gate
+{
+	std::vector<uint16_t> reference;    // the sampled rows of the last processed frame
+	int width, height, row_step;
+	uint16_t noise, cap;                // raw depth units
+	float threshold;                    // raw depth units per compared pixel; 0 processes every frame
+	int refresh_interval, since_refresh;
+	float last_motion;
+	unsigned long long skipped;
+
+	// Sum over one row of max(|a - b| - noise, 0), capped, where neither a nor b is 0.
+	uint64_t row_sad(const uint16_t * a, const uint16_t * b, int n) const
+	{
+		uint64_t sum = 0;
+		int x = 0;
+#ifdef MR_SSE2
+		const __m128i vnoise = _mm_set1_epi16((short)noise), vcap = _mm_set1_epi16((short)cap), ones = _mm_set1_epi16(1), zero = _mm_setzero_si128();
+		__m128i acc = _mm_setzero_si128();
+		for (; x + 8 <= n; x += 8)
+		{
+			const __m128i va = _mm_loadu_si128((const __m128i *)(a + x)), vb = _mm_loadu_si128((const __m128i *)(b + x));
+			__m128i d = _mm_or_si128(_mm_subs_epu16(va, vb), _mm_subs_epu16(vb, va));
+			d = mm_min_epu16(_mm_subs_epu16(d, vnoise), vcap);
+			const __m128i hole = _mm_or_si128(_mm_cmpeq_epi16(va, zero), _mm_cmpeq_epi16(vb, zero));
+			// cap <= 32767, so the signed multiply-add sums pairs of differences exactly
+			acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_andnot_si128(hole, d), ones));
+		}
+		alignas(16) uint32_t lanes[4];
+		_mm_store_si128((__m128i *)lanes, acc);
+		sum = (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+		for (; x < n; ++x)
+		{
+			if (!a[x] || !b[x]) continue;
+			const int d = std::abs((int)a[x] - (int)b[x]) - noise;
+			if (d > 0) sum += std::min(d, (int)cap);
+		}
+		return sum;
+	}
+public:
+	motion_gate(int row_step = 4) : width(), height(), row_step(std::max(1, row_step)), noise(), cap(32767), threshold(),
+		refresh_interval(30), since_refresh(), last_motion(), skipped() {}
+
+	// All in meters: a frame passes when the mean over the compared pixels exceeds threshold, or 0 to pass every
+	// frame; differences below noise are ignored and a pixel counts for at most cap. The defaults suit a hand at
+	// arm's length in front of a still scene. Cheap enough to call every frame.
+	void configure(float depth_scale, float threshold_m = 0.0005f, int refresh_frames = 30, float noise_m = 0.03f, float cap_m = 0.1f)
+	{
+		threshold = threshold_m / depth_scale;
+		refresh_interval = std::max(1, refresh_frames);
+		noise = (uint16_t)std::min(65535.0f, noise_m / depth_scale);
+		cap = (uint16_t)std::min(32767.0f, std::max(1.0f, cap_m / depth_scale));
+	}
+
+	// True if the frame should go through the full pipeline; it then becomes the new reference.
+	bool should_process(const uint16_t * depth, int w, int h)
+	{
+		const int rows = (h + row_step - 1) / row_step;
+		if (w != width || h != height)
+		{
+			width = w;
+			height = h;
+			reference.resize((size_t)rows * w);
+			since_refresh = refresh_interval; // nothing to compare against yet
+		}
+
+		uint64_t sum = 0;
+		for (int r = 0; r < rows; ++r) sum += row_sad(depth + (size_t)r * row_step * w, reference.data() + (size_t)r * w, w);
+		last_motion = (float)sum / ((size_t)rows * w);
+
+		if (threshold > 0 && last_motion <= threshold && ++since_refresh < refresh_interval)
+		{
+			++skipped;
+			return false;
+		}
+		since_refresh = 0;
+		for (int r = 0; r < rows; ++r) memcpy(reference.data() + (size_t)r * w, depth + (size_t)r * row_step * w, w * sizeof(uint16_t));
+		return true;
+	}
+
+	// mean per-pixel difference of the last frame checked, in raw depth units
+	float get_last_motion() const { return last_motion; }
+	unsigned long long get_skipped_count() const { return skipped; }
+};
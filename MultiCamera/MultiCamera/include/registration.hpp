@@ -0,0 +1,230 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "simd.hpp"
+#include "lens.hpp"
+#include "row_workers.hpp"
+
+//////////////////////////////
+// Depth/color registration //
+//////////////////////////////
+
+// Maps every depth pixel into the color image once per frame and builds both aligned products from that map:
+// a color image in depth pixel coordinates and a depth image in color pixel coordinates.
+//
+// Depth pixels are deprojected with a ray table built when the intrinsics change, transformed and projected
+// four at a time with SSE2, and the work is split into row bands over a small thread pool. Where several depth
+// pixels land on the same color pixel only the nearest sees it: a z-buffer in color space marks the others as
+// occluded, so background points don't pick up the color of a hand in front of them.
+class registration
+{
+	rs::intrinsics depth_intrin, color_intrin;
+	rs::extrinsics depth_to_color;
+	float depth_scale, occlusion_margin;
+	bool configured;
+
+	std::vector<float> ray_x, ray_y;   // deprojection of every depth pixel at 1 m
+	std::vector<int32_t> color_index;  // per depth pixel: offset into the color image, -1 if invisible
+	std::vector<float> color_z;        // per depth pixel: depth in the color camera, meters
+	std::vector<float> zbuffer;        // per color pixel: nearest color_z that landed on it
+	std::vector<uint8_t> aligned_color;
+	std::vector<uint16_t> aligned_depth;
+	bool aligned_depth_valid;
+	row_workers & workers;
+	void (registration::*map)(const uint16_t *, int, int); // map_pixels for the color stream's distortion model
+
+	void build_rays()
+	{
+		ray_x.resize(depth_intrin.width * depth_intrin.height);
+		ray_y.resize(depth_intrin.width * depth_intrin.height);
+		get_lens_kernels(depth_intrin.model()).rays(depth_intrin, ray_x.data(), ray_y.data());
+	}
+
+	// color_index and color_z for pixels [begin, end), projecting with color distortion model M.
+	template<rs::distortion M> void map_pixels(const uint16_t * depth, int begin, int end)
+	{
+		const float * r = depth_to_color.rotation, * t = depth_to_color.translation, * k = color_intrin.coeffs;
+		const bool distorted = M == rs::distortion::modified_brown_conrady;
+		const int cw = color_intrin.width, ch = color_intrin.height;
+		int i = begin;
+#ifdef MR_SSE2
+		const __m128 r0 = _mm_set1_ps(r[0]), r1 = _mm_set1_ps(r[1]), r2 = _mm_set1_ps(r[2]);
+		const __m128 r3 = _mm_set1_ps(r[3]), r4 = _mm_set1_ps(r[4]), r5 = _mm_set1_ps(r[5]);
+		const __m128 r6 = _mm_set1_ps(r[6]), r7 = _mm_set1_ps(r[7]), r8 = _mm_set1_ps(r[8]);
+		const __m128 t0 = _mm_set1_ps(t[0]), t1 = _mm_set1_ps(t[1]), t2 = _mm_set1_ps(t[2]);
+		const __m128 k0 = _mm_set1_ps(k[0]), k1 = _mm_set1_ps(k[1]), k4 = _mm_set1_ps(k[4]);
+		const __m128 k2x2 = _mm_set1_ps(2 * k[2]), k3x2 = _mm_set1_ps(2 * k[3]), k2 = _mm_set1_ps(k[2]), k3 = _mm_set1_ps(k[3]);
+		const __m128 fx = _mm_set1_ps(color_intrin.fx), fy = _mm_set1_ps(color_intrin.fy);
+		const __m128 ppx = _mm_set1_ps(color_intrin.ppx), ppy = _mm_set1_ps(color_intrin.ppy);
+		const __m128 scale = _mm_set1_ps(depth_scale), one = _mm_set1_ps(1.0f), zero = _mm_setzero_ps();
+		const __m128 width = _mm_set1_ps((float)cw), minus_half = _mm_set1_ps(-0.5f);
+		const __m128 last_x = _mm_set1_ps(cw - 0.5f), last_y = _mm_set1_ps(ch - 0.5f);
+		for (; i + 4 <= end; i += 4)
+		{
+			const __m128i d16 = _mm_loadl_epi64((const __m128i *)(depth + i));
+			const __m128 z = _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(d16, _mm_setzero_si128())), scale);
+			const __m128 px = _mm_mul_ps(_mm_loadu_ps(&ray_x[i]), z), py = _mm_mul_ps(_mm_loadu_ps(&ray_y[i]), z);
+
+			const __m128 cx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r0, px), _mm_mul_ps(r3, py)), _mm_add_ps(_mm_mul_ps(r6, z), t0));
+			const __m128 cy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r1, px), _mm_mul_ps(r4, py)), _mm_add_ps(_mm_mul_ps(r7, z), t1));
+			const __m128 cz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r2, px), _mm_mul_ps(r5, py)), _mm_add_ps(_mm_mul_ps(r8, z), t2));
+
+			// invalid depth gives cz = t2, which can be 0; keep the divide finite and mask the lane later
+			const __m128 in_front = _mm_and_ps(_mm_cmpgt_ps(cz, zero), _mm_cmpgt_ps(z, zero));
+			const __m128 inv = _mm_div_ps(one, _mm_or_ps(_mm_and_ps(in_front, cz), _mm_andnot_ps(in_front, one)));
+			__m128 x = _mm_mul_ps(cx, inv), y = _mm_mul_ps(cy, inv);
+			if (distorted)
+			{
+				// as rs_project_point_to_pixel: radial term from the undistorted radius, tangential from both
+				const __m128 r2 = _mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y));
+				const __m128 f = _mm_add_ps(one, _mm_mul_ps(r2, _mm_add_ps(k0, _mm_mul_ps(r2, _mm_add_ps(k1, _mm_mul_ps(r2, k4))))));
+				x = _mm_mul_ps(x, f);
+				y = _mm_mul_ps(y, f);
+				const __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), xy = _mm_mul_ps(x, y);
+				const __m128 dx = _mm_add_ps(_mm_add_ps(x, _mm_mul_ps(k2x2, xy)), _mm_mul_ps(k3, _mm_add_ps(r2, _mm_add_ps(xx, xx))));
+				const __m128 dy = _mm_add_ps(_mm_add_ps(y, _mm_mul_ps(k3x2, xy)), _mm_mul_ps(k2, _mm_add_ps(r2, _mm_add_ps(yy, yy))));
+				x = dx;
+				y = dy;
+			}
+			const __m128 u = _mm_add_ps(_mm_mul_ps(x, fx), ppx), v = _mm_add_ps(_mm_mul_ps(y, fy), ppy);
+
+			// rounds to a pixel inside the image: -0.5 <= u < width - 0.5
+			const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(u, minus_half), _mm_cmplt_ps(u, last_x)),
+				_mm_and_ps(_mm_cmpge_ps(v, minus_half), _mm_cmplt_ps(v, last_y)));
+			const __m128 valid = _mm_and_ps(in_front, inside);
+			const __m128 ur = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_and_ps(valid, u)));
+			const __m128 vr = _mm_cvtepi32_ps(_mm_cvtps_epi32(_mm_and_ps(valid, v)));
+			const __m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(vr, width), ur));
+			const __m128i mask = _mm_castps_si128(valid);
+			_mm_storeu_si128((__m128i *)&color_index[i], _mm_or_si128(_mm_and_si128(mask, index), _mm_andnot_si128(mask, _mm_set1_epi32(-1))));
+			_mm_storeu_ps(&color_z[i], cz);
+		}
+#endif
+		for (; i < end; ++i)
+		{
+			color_index[i] = -1;
+			if (!depth[i]) continue;
+			const float z = depth[i] * depth_scale;
+			const rs::float3 p = depth_to_color.transform({ ray_x[i] * z, ray_y[i] * z, z });
+			color_z[i] = p.z;
+			if (p.z <= 0) continue;
+			const rs::float2 c = lens_project<M>(color_intrin, p);
+			if (c.x < -0.5f || c.y < -0.5f || c.x >= cw - 0.5f || c.y >= ch - 0.5f) continue;
+			color_index[i] = (int)std::lrint(c.y) * cw + (int)std::lrint(c.x);
+		}
+	}
+public:
+	// occlusion_margin: how far (meters) behind the nearest surface on a color pixel a point may be and still
+	// count as seeing it. workers splits the per-frame passes into row bands; by default every registration
+	// uses the shared pool, so they must run from one thread.
+	explicit registration(float occlusion_margin = 0.02f, row_workers & workers = row_workers::shared())
+		: depth_scale(), occlusion_margin(occlusion_margin), configured(false), aligned_depth_valid(false), workers(workers),
+		map(&registration::map_pixels<rs::distortion::none>) {}
+
+	void set_occlusion_margin(float meters) { occlusion_margin = meters; }
+
+	// Cheap to call every frame; the ray table is only rebuilt when the depth intrinsics change.
+	void configure(const rs::intrinsics & depth, const rs::intrinsics & color, const rs::extrinsics & extrin, float scale)
+	{
+		if (!configured || !(depth == depth_intrin))
+		{
+			depth_intrin = depth;
+			build_rays();
+		}
+		color_intrin = color;
+		map = color.model() == rs::distortion::modified_brown_conrady ? &registration::map_pixels<rs::distortion::modified_brown_conrady>
+			: &registration::map_pixels<rs::distortion::none>;
+		depth_to_color = extrin;
+		depth_scale = scale;
+		configured = true;
+	}
+
+	// Registers one frame. color is rgb8 at the configured color intrinsics and may be null, in which case only
+	// the pixel map and z-buffer are built.
+	void process(const uint16_t * depth, const uint8_t * color)
+	{
+		const int dw = depth_intrin.width, dh = depth_intrin.height, cw = color_intrin.width, ch = color_intrin.height;
+		color_index.resize(dw * dh);
+		color_z.resize(dw * dh);
+		zbuffer.assign(cw * ch, FLT_MAX);
+		aligned_depth_valid = false;
+
+		workers.run(dh, [&](int y0, int y1) { (this->*map)(depth, y0 * dw, y1 * dw); });
+
+		// z-buffer: a serial scatter, but only one compare per pixel. When the color image is finer than the
+		// depth image each depth pixel covers a 2x2 block, otherwise holes would let background through.
+		const bool splat = color_intrin.fx > depth_intrin.fx * 1.5f;
+		for (int i = 0, n = dw * dh; i < n; ++i)
+		{
+			const int c = color_index[i];
+			if (c < 0) continue;
+			const float z = color_z[i];
+			zbuffer[c] = std::min(zbuffer[c], z);
+			if (splat)
+			{
+				const int cx = c % cw, cy = c / cw;
+				if (cx + 1 < cw) zbuffer[c + 1] = std::min(zbuffer[c + 1], z);
+				if (cy + 1 < ch)
+				{
+					zbuffer[c + cw] = std::min(zbuffer[c + cw], z);
+					if (cx + 1 < cw) zbuffer[c + cw + 1] = std::min(zbuffer[c + cw + 1], z);
+				}
+			}
+		}
+
+		// occlusion test, then gather the aligned color
+		if (color) aligned_color.resize(dw * dh * 3);
+		workers.run(dh, [&](int y0, int y1)
+		{
+			for (int i = y0 * dw, end = y1 * dw; i < end; ++i)
+			{
+				int c = color_index[i];
+				if (c >= 0 && color_z[i] > zbuffer[c] + occlusion_margin) c = color_index[i] = -1;
+				if (!color) continue;
+				uint8_t * dst = &aligned_color[i * 3];
+				if (c < 0) dst[0] = dst[1] = dst[2] = 0;
+				else
+				{
+					const uint8_t * src = color + c * 3;
+					dst[0] = src[0];
+					dst[1] = src[1];
+					dst[2] = src[2];
+				}
+			}
+		});
+	}
+
+	const rs::intrinsics & get_depth_intrinsics() const { return depth_intrin; }
+	const rs::intrinsics & get_color_intrinsics() const { return color_intrin; }
+
+	// Per depth pixel: offset of the color pixel it sees (multiply by 3 for rgb8), or -1 where it has no depth,
+	// falls outside the color image or is occluded.
+	const int32_t * get_color_index() const { return color_index.data(); }
+
+	// rgb8 color image in depth pixel coordinates, black where get_color_index() is -1.
+	const uint8_t * get_aligned_color() const { return aligned_color.data(); }
+
+	// z16 depth image in color pixel coordinates (raw units, as seen from the color camera), 0 where no depth
+	// pixel landed. Built on first use after each process().
+	const uint16_t * get_aligned_depth()
+	{
+		if (aligned_depth_valid) return aligned_depth.data();
+		const int cw = color_intrin.width, ch = color_intrin.height;
+		aligned_depth.resize(cw * ch);
+		const float inv_scale = 1.0f / depth_scale;
+		workers.run(ch, [&](int y0, int y1)
+		{
+			for (int i = y0 * cw, end = y1 * cw; i < end; ++i)
+			{
+				const float z = zbuffer[i];
+				aligned_depth[i] = z == FLT_MAX ? 0 : (uint16_t)std::min(65535.0f, z * inv_scale + 0.5f);
+			}
+		});
+		aligned_depth_valid = true;
+		return aligned_depth.data();
+	}
+};
@@ -0,0 +1,92 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//////////////////////////
+// Row-band thread pool //
+//////////////////////////
+
+// Splits per-frame image work into horizontal bands run in parallel. The threads are started once and sleep
+// between jobs, so a frame only pays for a wakeup, not for thread creation. The calling thread takes the
+// first band itself.
+class row_workers
+{
+	std::vector<std::thread> threads;
+	std::mutex mutex;
+	std::condition_variable start, done;
+	const std::function<void(int, int)> * job;
+	int rows, bands, pending;
+	unsigned long long generation;
+	bool quit;
+
+	void worker(int band)
+	{
+		unsigned long long seen = 0;
+		std::unique_lock<std::mutex> lock(mutex);
+		for (;;)
+		{
+			start.wait(lock, [&] { return quit || generation != seen; });
+			if (quit) return;
+			seen = generation;
+			const std::function<void(int, int)> & f = *job;
+			const int begin = rows * band / bands, end = rows * (band + 1) / bands;
+			lock.unlock();
+			if (begin < end) f(begin, end);
+			lock.lock();
+			if (--pending == 0) done.notify_one();
+		}
+	}
+public:
+	// bands of 0 uses one band per hardware thread.
+	explicit row_workers(int count = 0) : job(), rows(), pending(), generation(), quit(false)
+	{
+		bands = count > 0 ? count : std::max(1, (int)std::thread::hardware_concurrency());
+		for (int i = 1; i < bands; ++i) threads.emplace_back(&row_workers::worker, this, i);
+	}
+	~row_workers()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			quit = true;
+		}
+		start.notify_all();
+		for (auto & t : threads) t.join();
+	}
+
+	int get_band_count() const { return bands; }
+
+	// A pool with one band per hardware thread for users that take turns on the same thread, such as one
+	// registration per camera in a single render loop, so they don't each start a thread per core. run() is not
+	// reentrant: users on different threads need pools of their own.
+	static row_workers & shared()
+	{
+		static row_workers pool;
+		return pool;
+	}
+
+	// Calls f(begin, end) over disjoint row ranges covering [0, row_count) and returns when all are done.
+	void run(int row_count, const std::function<void(int, int)> & f)
+	{
+		if (bands == 1 || row_count < bands)
+		{
+			f(0, row_count);
+			return;
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = &f;
+			rows = row_count;
+			pending = bands - 1;
+			++generation;
+		}
+		start.notify_all();
+		f(0, row_count / bands);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&] { return pending == 0; });
+	}
+};
@@ -0,0 +1,33 @@
+#pragma once
+
+// SSE2 is always available on x64 and is the default for Win32 builds since VS2012.
+// Everything that uses it keeps a scalar path for /arch:IA32 and non-x86 builds.
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MR_SSE2 1
+#include <emmintrin.h>
+
+// SSE2 only has signed 16-bit min/max/compare, so flip the sign bit to get the unsigned versions.
+inline __m128i mm_min_epu16(__m128i a, __m128i b)
+{
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	return _mm_xor_si128(_mm_min_epi16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias)), bias);
+}
+
+inline __m128i mm_max_epu16(__m128i a, __m128i b)
+{
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	return _mm_xor_si128(_mm_max_epi16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias)), bias);
+}
+
+inline __m128i mm_cmpgt_epu16(__m128i a, __m128i b)
+{
+	const __m128i bias = _mm_set1_epi16((short)0x8000);
+	return _mm_cmpgt_epi16(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+// mask ? a : b
+inline __m128i mm_select_si128(__m128i mask, __m128i a, __m128i b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+#endif
@@ -0,0 +1,39 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+/////////////////////////
+// Lock-free SPSC ring //
+/////////////////////////
+
+// Single-producer single-consumer ring of preallocated slots. The producer fills acquire_write() in place and
+// publishes it with commit_write(); the consumer reads front() in place and frees it with pop(). No locks, and
+// the slots (and any buffers they own) are reused forever.
+template<class T, size_t N> class spsc_ring
+{
+	static_assert((N & (N - 1)) == 0, "ring size must be a power of two");
+	T slots[N];
+	std::atomic<size_t> head; // next slot to read, owned by the consumer
+	char pad[64];             // keep the two indices on separate cache lines
+	std::atomic<size_t> tail; // next slot to write, owned by the producer
+public:
+	spsc_ring() : head(0), tail(0) {}
+
+	T * acquire_write()
+	{
+		const size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) return nullptr;
+		return &slots[t & (N - 1)];
+	}
+	void commit_write() { tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	T * front()
+	{
+		const size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return nullptr;
+		return &slots[h & (N - 1)];
+	}
+	void pop() { head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+	size_t size() const { return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire); }
+};
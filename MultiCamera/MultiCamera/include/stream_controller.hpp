@@ -0,0 +1,278 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+////////////////////////////////
+// Adaptive stream controller //
+////////////////////////////////
+
+// Share of a frame interval processing may use, and of its limit a mode must be predicted to use before the
+// controller moves up to it.
+const float STREAM_HEADROOM = 0.8f, STREAM_UP_MARGIN = 0.7f;
+
+// Limits on the modes a profile may pick from; 0 means no limit.
+struct stream_profile
+{
+	int max_width, max_height;
+	int min_fps, max_fps;
+};
+
+// Picks the depth (and color) stream mode from what the device actually offers, and moves between modes as the
+// measured processing time allows: the most expensive mode whose predicted per-frame time stays within the
+// latency budget and leaves headroom within the frame interval, so frames don't queue up.
+//
+// Processing time is taken to scale with the pixel count, so one mode's measurement predicts every other
+// mode's. A mode is only moved up to with a margin to spare, and a backlog of frames moves down at once. Two
+// profiles, idle and active, bound the choice: an installation with nobody in front of it can drop to a cheap
+// mode and come back when someone steps up.
+//
+// report() and set_active() belong to the thread doing the processing, apply() to the one waiting for frames
+// (they may be the same thread). A switch stops and restarts the device's streams, keeping the context and the
+// device, and is never taken mid-frame.
+class stream_controller
+{
+public:
+	struct mode
+	{
+		int width, height, framerate;      // depth
+		int color_width, color_height;     // 0 without color
+		double cost() const { return (double)width * height * framerate; }
+	};
+private:
+	std::vector<mode> modes;               // cheapest first
+	rs::format color_format;               // rs::format::any without color
+	stream_profile profiles[2];
+	std::atomic<int> target, current;      // indices into modes, current -1 until started
+	std::atomic<bool> active;
+	std::atomic<int> switches;
+	float budget_ms;
+
+	// processing thread only
+	int measured;                          // mode the statistics below belong to
+	float mean_ms, mean_backlog;
+	float ms_per_pixel;                    // from the last full window, 0 before the first
+	int samples;
+
+	static const int SETTLE_FRAMES = 30;   // frames ignored after a switch while things warm up
+	static const int WINDOW_FRAMES = 60;   // frames averaged before a decision
+
+	bool allowed(const mode & m, const stream_profile & p) const
+	{
+		return (!p.max_width || m.width <= p.max_width) && (!p.max_height || m.height <= p.max_height)
+			&& (!p.min_fps || m.framerate >= p.min_fps) && (!p.max_fps || m.framerate <= p.max_fps);
+	}
+
+	// per-frame time a mode may take: the budget, and no more than part of its frame interval
+	float limit(const mode & m) const { return std::min(budget_ms, STREAM_HEADROOM * 1000.0f / m.framerate); }
+
+	// The most expensive allowed mode predicted to fit, from ms_per_pixel; with nothing measured yet, the most
+	// expensive allowed mode. Falls back to the cheapest allowed mode, then to the cheapest of all.
+	int choose(float ms_per_pixel, float margin) const
+	{
+		const stream_profile & p = profiles[active ? 1 : 0];
+		int best = -1, cheapest = -1;
+		for (int i = 0; i < (int)modes.size(); ++i)
+		{
+			if (!allowed(modes[i], p)) continue;
+			if (cheapest < 0) cheapest = i;
+			if (ms_per_pixel <= 0 || ms_per_pixel * modes[i].width * modes[i].height <= margin * limit(modes[i])) best = i;
+		}
+		return best >= 0 ? best : cheapest >= 0 ? cheapest : 0;
+	}
+
+	void enable(rs::device & dev, const mode & m) const
+	{
+		dev.enable_stream(rs::stream::depth, m.width, m.height, rs::format::z16, m.framerate);
+		if (m.color_width) dev.enable_stream(rs::stream::color, m.color_width, m.color_height, color_format, m.framerate);
+		else if (dev.is_stream_enabled(rs::stream::color)) dev.disable_stream(rs::stream::color);
+	}
+
+	// index of the mode nearest to the given size and rate
+	int nearest(int width, int height, int framerate) const
+	{
+		int pick = 0;
+		double best = -1;
+		for (int i = 0; i < (int)modes.size(); ++i)
+		{
+			const double d = std::abs(std::log((double)modes[i].width * modes[i].height / ((double)width * height)))
+				+ std::abs(std::log((double)modes[i].framerate / framerate));
+			if (best < 0 || d < best) { best = d; pick = i; }
+		}
+		return pick;
+	}
+public:
+	stream_controller() : color_format(rs::format::any), target(-1), current(-1), active(true), switches(0), budget_ms(12), measured(-1), mean_ms(), mean_backlog(),
+		ms_per_pixel(), samples()
+	{
+		profiles[0] = profiles[1] = stream_profile();
+	}
+
+	// Lists the device's z16 depth modes, each paired with a color mode in color at the same frame rate,
+	// preferring the color resolution closest to the depth one; depth modes without such a color mode are left
+	// out. With rs::format::any for color, depth alone. Returns false if nothing usable was found.
+	bool enumerate(rs::device & dev, rs::format color)
+	{
+		color_format = color;
+		const bool with_color = color != rs::format::any;
+		modes.clear();
+		const int depth_count = dev.get_stream_mode_count(rs::stream::depth);
+		const int color_count = with_color ? dev.get_stream_mode_count(rs::stream::color) : 0;
+		for (int i = 0; i < depth_count; ++i)
+		{
+			mode m = {};
+			rs::format format;
+			dev.get_stream_mode(rs::stream::depth, i, m.width, m.height, format, m.framerate);
+			if (format != rs::format::z16) continue;
+			if (with_color)
+			{
+				long long best = -1;
+				for (int j = 0; j < color_count; ++j)
+				{
+					int w, h, fps;
+					dev.get_stream_mode(rs::stream::color, j, w, h, format, fps);
+					if (format != color || fps != m.framerate) continue;
+					const long long distance = std::llabs((long long)w * h - (long long)m.width * m.height);
+					if (best < 0 || distance < best)
+					{
+						best = distance;
+						m.color_width = w;
+						m.color_height = h;
+					}
+				}
+				if (best < 0) continue;
+			}
+			bool duplicate = false;
+			for (auto & o : modes) duplicate |= o.width == m.width && o.height == m.height && o.framerate == m.framerate;
+			if (!duplicate) modes.push_back(m);
+		}
+		std::sort(modes.begin(), modes.end(), [](const mode & a, const mode & b) { return a.cost() < b.cost(); });
+		return !modes.empty();
+	}
+
+	// Per-frame processing time to stay within, in ms; 0 keeps the current mode.
+	void set_budget(float ms) { budget_ms = ms; }
+	void set_profiles(const stream_profile & idle, const stream_profile & busy) { profiles[0] = idle; profiles[1] = busy; }
+
+	// Switches profile; the new profile's mode is picked right away rather than after a full window.
+	void set_active(bool busy)
+	{
+		if (busy == active.load()) return;
+		active = busy;
+		if (budget_ms <= 0) return;
+		target = choose(ms_per_pixel, STREAM_UP_MARGIN);
+	}
+	bool is_active() const { return active; }
+
+	// Enables and starts the streams in the mode closest to the requested one (0 for the best mode the active
+	// profile allows), on a device that is not streaming yet. Returns false if enumerate() found nothing.
+	bool start(rs::device & dev, int width = 0, int height = 0, int framerate = 0)
+	{
+		if (modes.empty()) return false;
+		const int pick = width && height && framerate ? nearest(width, height, framerate) : choose(0, 1);
+		enable(dev, modes[pick]);
+		dev.start();
+		target = current = pick;
+		return true;
+	}
+
+	// Call once per processed frame with the time the processing took and how many frames were waiting or were
+	// missed meanwhile.
+	void report(float processing_ms, int backlog)
+	{
+		const int now = current;
+		if (now < 0 || budget_ms <= 0) return;
+		if (now != measured)
+		{
+			measured = now;
+			samples = -SETTLE_FRAMES;
+			mean_ms = mean_backlog = 0;
+		}
+		if (++samples <= 0) return;
+		mean_ms += (processing_ms - mean_ms) / samples;
+		mean_backlog += (backlog - mean_backlog) / samples;
+		if (samples < WINDOW_FRAMES || target != now) return;
+
+		const mode & m = modes[now];
+		const float per_pixel = ms_per_pixel = mean_ms / ((float)m.width * m.height);
+		int next = now;
+		if (mean_ms > limit(m) || mean_backlog > 0.5f)
+		{
+			// over budget or falling behind: the best mode that fits, and at least one step down
+			next = std::min(choose(per_pixel, 1), now - 1);
+			if (next < 0) next = 0;
+		}
+		else
+		{
+			// up when there is room, or anywhere the profile allows if it no longer allows this mode
+			const int up = choose(per_pixel, STREAM_UP_MARGIN);
+			if (up > now || !allowed(m, profiles[active ? 1 : 0])) next = up;
+		}
+		if (next != now) target = next;
+		samples = 0;
+		mean_ms = mean_backlog = 0;
+	}
+
+	// Restarts the streams if a different mode is wanted; returns whether it did. Call between frames on the
+	// thread that waits for them; intrinsics and frame sizes change after a restart.
+	bool apply(rs::device & dev)
+	{
+		const int want = target, now = current;
+		if (want < 0 || want == now) return false;
+		dev.stop();
+		enable(dev, modes[want]);
+		dev.start();
+		current = want;
+		++switches;
+		return true;
+	}
+
+	// Starts the streams again in the current mode, on a device that was stopped or lost them; for recovery.
+	void restart(rs::device & dev)
+	{
+		const int now = current;
+		if (now >= 0) enable(dev, modes[now]);
+		dev.start();
+	}
+
+	// Uses a mode list saved from an earlier enumerate() of the same device and color format.
+	void set_modes(const std::vector<mode> & list, rs::format color)
+	{
+		modes = list;
+		color_format = color;
+	}
+
+	// Changes the color stream's format, or turns color off with rs::format::any, restarting the streams in the
+	// mode nearest to the current one. Same thread rules as apply(); returns false if nothing changed or the
+	// device has no mode for it, in which case it keeps streaming as it was.
+	bool set_color_format(rs::device & dev, rs::format color)
+	{
+		const int now = current;
+		if (color == color_format || now < 0) return false;
+		const mode old = modes[now];
+		const rs::format old_format = color_format;
+		if (!enumerate(dev, color))
+		{
+			enumerate(dev, old_format);
+			return false;
+		}
+		const int pick = nearest(old.width, old.height, old.framerate);
+		dev.stop();
+		enable(dev, modes[pick]);
+		dev.start();
+		target = current = pick;
+		measured = -1;
+		++switches;
+		return true;
+	}
+	rs::format get_color_format() const { return color_format; }
+
+	const std::vector<mode> & get_modes() const { return modes; }
+	// the mode streaming now; only valid after start()
+	const mode & get_mode() const { return modes[std::max(0, current.load())]; }
+	int get_switch_count() const { return switches; }
+	float get_mean_ms() const { return mean_ms; }
+};
@@ -0,0 +1,113 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "simd.hpp"
+
+//////////////////////////////
+// Temporal depth filtering //
+//////////////////////////////
+
+// In-place temporal filter for z16 frames. Pixels whose depth stays within delta of the previous output are
+// smoothed exponentially, larger jumps are taken as-is so real motion is not smeared, and pixels that drop
+// out (depth 0) keep their last value for up to persistence frames. This removes the single-frame holes and
+// spikes that make hard thresholds such as "closer than 800 mm" flicker.
+//
+// History is kept as two planar arrays (16-bit depth, 8-bit age) so the SSE2 path streams through them
+// alongside the frame: 3 bytes of state per pixel.
+class temporal_filter
+{
+	std::vector<uint16_t> history;
+	std::vector<uint8_t> age;
+	int width, height;
+	int16_t alpha_q15;
+	uint16_t delta;
+	uint8_t persistence;
+public:
+	// alpha is the weight of the new frame (0-1], delta the largest step in raw depth units that is still smoothed,
+	// persistence the number of frames a lost pixel is held for.
+	temporal_filter(float alpha = 0.4f, int delta = 20, int persistence = 3) : width(), height()
+	{
+		set_alpha(alpha);
+		set_delta(delta);
+		set_persistence(persistence);
+	}
+
+	void set_alpha(float a) { alpha_q15 = (int16_t)(std::max(0.0f, std::min(a, 1.0f)) * 32767); }
+	// Limited so that the signed difference doubled still fits in 16 bits.
+	void set_delta(int d) { delta = (uint16_t)std::max(0, std::min(d, 16383)); }
+	void set_persistence(int p) { persistence = (uint8_t)std::max(0, std::min(p, 254)); }
+
+	void reset()
+	{
+		std::fill(history.begin(), history.end(), 0);
+		std::fill(age.begin(), age.end(), 0);
+	}
+
+	void process(uint16_t * depth, int w, int h)
+	{
+		if (w != width || h != height)
+		{
+			width = w;
+			height = h;
+			history.assign(w * h, 0);
+			age.assign(w * h, 0);
+		}
+
+		const int n = w * h;
+		uint16_t * hist = history.data();
+		uint8_t * ages = age.data();
+		int i = 0;
+#ifdef MR_SSE2
+		const __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+		const __m128i vdelta = _mm_set1_epi16((short)delta), valpha = _mm_set1_epi16(alpha_q15), vpersist = _mm_set1_epi16(persistence);
+		for (; i + 8 <= n; i += 8)
+		{
+			const __m128i cur = _mm_loadu_si128((const __m128i *)(depth + i));
+			const __m128i prev = _mm_loadu_si128((const __m128i *)(hist + i));
+			const __m128i prev_age = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(ages + i)), zero);
+
+			const __m128i cur_missing = _mm_cmpeq_epi16(cur, zero);
+			const __m128i prev_missing = _mm_cmpeq_epi16(prev, zero);
+
+			// Smooth only small steps from a valid history: (cur - prev) * alpha, with the difference in Q1 so mulhi yields Q15.
+			const __m128i absdiff = _mm_or_si128(_mm_subs_epu16(cur, prev), _mm_subs_epu16(prev, cur));
+			const __m128i close = _mm_andnot_si128(prev_missing, mm_cmpgt_epu16(vdelta, absdiff));
+			const __m128i step = _mm_mulhi_epi16(_mm_slli_epi16(_mm_sub_epi16(cur, prev), 1), valpha);
+			const __m128i measured = mm_select_si128(close, _mm_add_epi16(prev, step), cur);
+
+			// Hold the last value of a lost pixel while it is young enough.
+			const __m128i hold = _mm_andnot_si128(prev_missing, _mm_cmpgt_epi16(vpersist, prev_age));
+			const __m128i out = mm_select_si128(cur_missing, _mm_and_si128(hold, prev), measured);
+			const __m128i out_age = _mm_and_si128(cur_missing, mm_select_si128(hold, _mm_add_epi16(prev_age, one), vpersist));
+
+			_mm_storeu_si128((__m128i *)(depth + i), out);
+			_mm_storeu_si128((__m128i *)(hist + i), out);
+			_mm_storel_epi64((__m128i *)(ages + i), _mm_packus_epi16(out_age, zero));
+		}
+#endif
+		for (; i < n; ++i)
+		{
+			const uint16_t cur = depth[i], prev = hist[i];
+			uint16_t out;
+			if (cur)
+			{
+				const int diff = cur - prev;
+				if (prev && (diff < 0 ? -diff : diff) < delta) out = (uint16_t)(prev + ((diff * 2 * alpha_q15) >> 16));
+				else out = cur;
+				ages[i] = 0;
+			}
+			else if (prev && ages[i] < persistence)
+			{
+				out = prev;
+				++ages[i];
+			}
+			else
+			{
+				out = 0;
+				ages[i] = persistence;
+			}
+			depth[i] = hist[i] = out;
+		}
+	}
+};
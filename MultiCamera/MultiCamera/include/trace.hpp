@@ -0,0 +1,217 @@
+#pragma once
+
+//////////////////////
+// Pipeline tracing //
+//////////////////////
+
+// Scoped timing spans written to a per-thread ring and dumped as Chrome trace-event JSON, which chrome://tracing
+// and ui.perfetto.dev open as a timeline with one track per thread.
+//
+//     MR_TRACE_THREAD("render");              // names the calling thread's track
+//     MR_TRACE_THREAD_ID("capture", camera);  // names it "capture <camera>"
+//     MR_TRACE_SCOPE("runCamera");            // span from here to the end of the enclosing block
+//     MR_TRACE_SCOPE_ID("runCamera", camera); // same, tagged with a number (camera index, frame...)
+//     MR_TRACE_DUMP("trace.json");            // on demand, from any thread; false if not written
+//     MR_TRACE_DUMP_AT_EXIT("trace.json");
+//
+// Everything compiles to nothing unless MR_ENABLE_TRACE is defined. When enabled, a span costs two timestamp
+// reads and one store into the thread's ring, with no locks; a thread only takes the registry lock once, for
+// its first span. Each ring keeps the last RING_SIZE spans of its thread.
+
+#ifdef MR_ENABLE_TRACE
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define MR_TRACE_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MR_TRACE_TSC 1
+#endif
+
+namespace mr_trace
+{
+	const size_t RING_SIZE = 1 << 16;
+
+	struct span
+	{
+		const char * name;   // must be a string literal or otherwise outlive the dump
+		int64_t begin, end;  // ticks
+		int id;              // -1 when the span has none
+	};
+
+	struct ring
+	{
+		span spans[RING_SIZE];
+		std::atomic<uint64_t> count; // spans ever written; only the owning thread stores it
+		std::string name;
+		int tid;
+		ring() : count(0), tid(0) {}
+	};
+
+	// The time stamp counter is a few ns to read where the clock call can be tens; dump() converts ticks to
+	// microseconds with a rate measured against steady_clock over the life of the trace.
+	inline int64_t ticks()
+	{
+#ifdef MR_TRACE_TSC
+		return (int64_t)__rdtsc();
+#else
+		return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+	}
+
+	struct registry
+	{
+		std::mutex mutex;
+		std::vector<std::shared_ptr<ring>> rings; // kept after their threads exit so their spans still dump
+		int64_t start_ticks;
+		std::chrono::steady_clock::time_point start_time;
+		std::string exit_path;
+		registry() : start_ticks(ticks()), start_time(std::chrono::steady_clock::now()) {}
+	};
+
+	inline registry & get_registry()
+	{
+		static registry r;
+		return r;
+	}
+
+	// Rings are owned by the registry and outlive their threads, so the thread only needs a plain pointer.
+	inline ring & local_ring()
+	{
+		thread_local ring * local = nullptr;
+		if (!local)
+		{
+			std::shared_ptr<ring> created = std::make_shared<ring>();
+			registry & r = get_registry();
+			std::lock_guard<std::mutex> lock(r.mutex);
+			created->tid = (int)r.rings.size() + 1;
+			r.rings.push_back(created);
+			local = created.get();
+		}
+		return *local;
+	}
+
+	inline void name_thread(const char * name, int id = -1)
+	{
+		ring & r = local_ring();
+		std::lock_guard<std::mutex> lock(get_registry().mutex);
+		r.name = id < 0 ? name : name + (" " + std::to_string(id));
+	}
+
+	class scope
+	{
+		const char * name;
+		int id;
+		int64_t begin;
+	public:
+		scope(const char * name, int id = -1) : name(name), id(id), begin(ticks()) {}
+		~scope()
+		{
+			const int64_t end = ticks();
+			ring & r = local_ring();
+			const uint64_t n = r.count.load(std::memory_order_relaxed);
+			span & s = r.spans[n & (RING_SIZE - 1)];
+			s.name = name;
+			s.begin = begin;
+			s.end = end;
+			s.id = id;
+			r.count.store(n + 1, std::memory_order_release);
+		}
+		scope(const scope &) = delete;
+		scope & operator=(const scope &) = delete;
+	};
+
+	// Writes every thread's retained spans to path; returns false if the file could not be written. Threads keep
+	// tracing meanwhile: spans they overwrite during the dump are left out rather than written torn.
+	inline bool dump(const char * path)
+	{
+		registry & r = get_registry();
+		std::vector<std::shared_ptr<ring>> rings;
+		std::vector<std::string> names;
+		{
+			std::lock_guard<std::mutex> lock(r.mutex);
+			rings = r.rings;
+			for (auto & g : rings) names.push_back(g->name);
+		}
+
+		const double elapsed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - r.start_time).count();
+		const int64_t elapsed_ticks = ticks() - r.start_ticks;
+		const double us_per_tick = elapsed_ticks > 0 ? elapsed_us / elapsed_ticks : 0;
+
+		FILE * file = fopen(path, "w");
+		if (!file) return false;
+		fprintf(file, "{\"traceEvents\":[\n");
+		bool first = true;
+		std::vector<span> copy;
+		for (size_t t = 0; t < rings.size(); ++t)
+		{
+			ring & g = *rings[t];
+			if (!names[t].empty())
+			{
+				fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}", first ? "" : ",\n", g.tid, names[t].c_str());
+				first = false;
+			}
+
+			// copy, then keep only the spans the owner cannot have overwritten while we were copying
+			const uint64_t before = g.count.load(std::memory_order_acquire);
+			const uint64_t from = before > RING_SIZE ? before - RING_SIZE : 0;
+			copy.assign(RING_SIZE, span());
+			for (uint64_t i = from; i < before; ++i) copy[i & (RING_SIZE - 1)] = g.spans[i & (RING_SIZE - 1)];
+			const uint64_t after = g.count.load(std::memory_order_acquire);
+			const uint64_t safe = after >= RING_SIZE ? std::max(from, after - RING_SIZE + 1) : from;
+
+			for (uint64_t i = safe; i < before; ++i)
+			{
+				const span & s = copy[i & (RING_SIZE - 1)];
+				fprintf(file, "%s{\"ph\":\"X\",\"name\":\"%s\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", first ? "" : ",\n",
+					s.name, g.tid, (s.begin - r.start_ticks) * us_per_tick, (s.end - s.begin) * us_per_tick);
+				if (s.id >= 0) fprintf(file, ",\"args\":{\"id\":%d}", s.id);
+				fprintf(file, "}");
+				first = false;
+			}
+		}
+		fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+		return fclose(file) == 0;
+	}
+
+	inline void dump_at_exit(const char * path)
+	{
+		registry & r = get_registry();
+		{
+			std::lock_guard<std::mutex> lock(r.mutex);
+			if (!r.exit_path.empty())
+			{
+				r.exit_path = path;
+				return;
+			}
+			r.exit_path = path;
+		}
+		std::atexit([] { dump(get_registry().exit_path.c_str()); });
+	}
+}
+
+#define MR_TRACE_CONCAT_(a, b) a##b
+#define MR_TRACE_CONCAT(a, b) MR_TRACE_CONCAT_(a, b)
+#define MR_TRACE_SCOPE(name) mr_trace::scope MR_TRACE_CONCAT(mr_trace_scope_, __LINE__)(name)
+#define MR_TRACE_SCOPE_ID(name, id) mr_trace::scope MR_TRACE_CONCAT(mr_trace_scope_, __LINE__)(name, (int)(id))
+#define MR_TRACE_THREAD(name) mr_trace::name_thread(name)
+#define MR_TRACE_THREAD_ID(name, id) mr_trace::name_thread(name, (int)(id))
+#define MR_TRACE_DUMP(path) mr_trace::dump(path)
+#define MR_TRACE_DUMP_AT_EXIT(path) mr_trace::dump_at_exit(path)
+#else
+#define MR_TRACE_SCOPE(name) ((void)0)
+#define MR_TRACE_SCOPE_ID(name, id) ((void)0)
+#define MR_TRACE_THREAD(name) ((void)0)
+#define MR_TRACE_THREAD_ID(name, id) ((void)0)
+#define MR_TRACE_DUMP(path) ((void)(path), false)
+#define MR_TRACE_DUMP_AT_EXIT(path) ((void)(path))
+#endif
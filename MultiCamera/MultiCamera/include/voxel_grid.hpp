@@ -0,0 +1,163 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+///////////////////////
+// Sparse voxel grid //
+///////////////////////
+
+struct voxel
+{
+	int32_t x, y, z;   // cell coordinates
+	uint32_t count;    // points that fell into the cell this frame
+	float sum_x, sum_y, sum_z;
+
+	rs::float3 centroid() const { return { sum_x / count, sum_y / count, sum_z / count }; }
+};
+
+// Hash-based sparse voxel grid for binning point clouds. Cells live in an open-addressing table that is
+// cleared in O(1) between frames by bumping a generation counter, so a grid reused every frame only
+// allocates when the number of occupied cells outgrows the table. Queries walk the list of occupied cells,
+// which is a few thousand entries for a typical scene instead of hundreds of thousands of points.
+class voxel_grid
+{
+	struct slot
+	{
+		uint32_t generation;
+		uint32_t voxel;    // index into voxels
+	};
+
+	float cell_size, inv_cell_size;
+	std::vector<slot> slots;
+	std::vector<voxel> voxels;
+	uint32_t generation;
+
+	static uint32_t hash(int32_t x, int32_t y, int32_t z)
+	{
+		return ((uint32_t)x * 73856093u) ^ ((uint32_t)y * 19349663u) ^ ((uint32_t)z * 83492791u);
+	}
+
+	// Keeps the table at most half full so probe sequences stay short.
+	void grow()
+	{
+		std::vector<slot> old(slots.size() * 2);
+		slots.swap(old);
+		generation = 1;
+		const uint32_t mask = (uint32_t)slots.size() - 1;
+		for (uint32_t i = 0; i < voxels.size(); ++i)
+		{
+			uint32_t h = hash(voxels[i].x, voxels[i].y, voxels[i].z) & mask;
+			while (slots[h].generation == generation) h = (h + 1) & mask;
+			slots[h].generation = generation;
+			slots[h].voxel = i;
+		}
+	}
+public:
+	// capacity is the expected number of occupied cells per frame.
+	voxel_grid(float cell = 0.01f, int capacity = 8192) : generation(1)
+	{
+		set_cell_size(cell);
+		uint32_t size = 16;
+		while (size < (uint32_t)capacity * 2) size *= 2;
+		slots.resize(size, slot{ 0, 0 });
+		voxels.reserve(capacity);
+	}
+
+	// Changing the cell size invalidates the current contents.
+	void set_cell_size(float cell) { cell_size = cell; inv_cell_size = 1.0f / cell; clear(); }
+	float get_cell_size() const { return cell_size; }
+
+	void clear()
+	{
+		voxels.clear();
+		if (++generation == 0)
+		{
+			// Wrapped around: stale slots could now look current, so wipe them once.
+			for (auto & s : slots) s.generation = 0;
+			generation = 1;
+		}
+	}
+
+	void insert(const rs::float3 & p)
+	{
+		const int32_t x = (int32_t)std::floor(p.x * inv_cell_size);
+		const int32_t y = (int32_t)std::floor(p.y * inv_cell_size);
+		const int32_t z = (int32_t)std::floor(p.z * inv_cell_size);
+
+		const uint32_t mask = (uint32_t)slots.size() - 1;
+		uint32_t h = hash(x, y, z) & mask;
+		for (;; h = (h + 1) & mask)
+		{
+			slot & s = slots[h];
+			if (s.generation != generation)
+			{
+				s.generation = generation;
+				s.voxel = (uint32_t)voxels.size();
+				voxels.push_back(voxel{ x, y, z, 1, p.x, p.y, p.z });
+				if (voxels.size() * 2 > slots.size()) grow();
+				return;
+			}
+			voxel & v = voxels[s.voxel];
+			if (v.x == x && v.y == y && v.z == z)
+			{
+				++v.count;
+				v.sum_x += p.x;
+				v.sum_y += p.y;
+				v.sum_z += p.z;
+				return;
+			}
+		}
+	}
+
+	void insert(const rs::float3 * points, size_t n)
+	{
+		for (size_t i = 0; i < n; ++i) insert(points[i]);
+	}
+
+	size_t size() const { return voxels.size(); }
+	const voxel & operator [] (size_t i) const { return voxels[i]; }
+	const voxel * begin() const { return voxels.data(); }
+	const voxel * end() const { return voxels.data() + voxels.size(); }
+
+	// Box queries test each cell's centroid against [lo, hi].
+	static bool inside(const rs::float3 & p, const rs::float3 & lo, const rs::float3 & hi)
+	{
+		return p.x >= lo.x && p.y >= lo.y && p.z >= lo.z && p.x <= hi.x && p.y <= hi.y && p.z <= hi.z;
+	}
+
+	// Number of occupied cells in the box. Unlike a point count this does not depend on the sensor resolution.
+	uint32_t voxels_in_box(const rs::float3 & lo, const rs::float3 & hi) const
+	{
+		uint32_t n = 0;
+		for (const voxel & v : voxels) n += inside(v.centroid(), lo, hi);
+		return n;
+	}
+
+	// Number of points in the cells that lie in the box.
+	uint32_t count_in_box(const rs::float3 & lo, const rs::float3 & hi) const
+	{
+		uint32_t n = 0;
+		for (const voxel & v : voxels) if (inside(v.centroid(), lo, hi)) n += v.count;
+		return n;
+	}
+
+	// Point-weighted centroid of the cells in the box; false if the box is empty.
+	bool centroid_in_box(const rs::float3 & lo, const rs::float3 & hi, rs::float3 & centroid) const
+	{
+		double x = 0, y = 0, z = 0;
+		uint32_t n = 0;
+		for (const voxel & v : voxels)
+		{
+			if (!inside(v.centroid(), lo, hi)) continue;
+			x += v.sum_x;
+			y += v.sum_y;
+			z += v.sum_z;
+			n += v.count;
+		}
+		if (!n) return false;
+		centroid = { (float)(x / n), (float)(y / n), (float)(z / n) };
+		return true;
+	}
+};
@@ -0,0 +1,203 @@
+#include <jni.h>
+#include "pointerLib.h"
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+// JNI bindings for JavaProject/src/PointerLib.java, built as their own DLL (pointerJNI) on top of pointerLib so
+// that neither pointerLib nor its other users need a JDK. Frames reach Java through direct ByteBuffers over native
+// buffers that are allocated once, and events through primitive arrays the caller reuses, so nothing is
+// allocated on the Java heap per frame.
+
+// Triple-buffered frames: the capture thread writes a slot that is neither the newest frame nor the one Java
+// holds, so it never waits and Java never sees a frame being written.
+class frame_pool
+{
+public:
+	static const int SLOTS = 3;
+private:
+	std::vector<uint8_t> buffers[SLOTS];
+	std::mutex lock;
+	int latest, held, writing;
+	uint64_t count, acquired;
+public:
+	frame_pool() : latest(-1), held(-1), writing(-1), count(0), acquired(0) {}
+
+	void allocate(size_t bytes) { for (auto & b : buffers) b.assign(bytes, 0); }
+	uint8_t * data(int slot) { return buffers[slot].data(); }
+	size_t get_size() const { return buffers[0].size(); }
+
+	// producer
+	uint8_t * begin_write()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (writing = 0; writing == latest || writing == held; ++writing);
+		return buffers[writing].data();
+	}
+	void end_write()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		latest = writing;
+		++count;
+	}
+
+	// consumer: the slot of the newest frame if it wasn't acquired before, else -1. The slot stays valid until release().
+	int acquire()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		if (latest < 0 || count == acquired) return -1;
+		acquired = count;
+		return held = latest;
+	}
+	void release()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		held = -1;
+	}
+};
+
+static frame_pool depthPool, colorPool;
+static int depthWidth, depthHeight, colorWidth, colorHeight;
+static pointer_event events[256];
+static bool initialized;
+
+static void copyFrames(const uint16_t *depth, int dw, int dh, const uint8_t *rgb, int cw, int ch, void *)
+{
+	const size_t depthBytes = (size_t)dw * dh * 2;
+	if (depthBytes <= depthPool.get_size())
+	{
+		memcpy(depthPool.begin_write(), depth, depthBytes);
+		depthPool.end_write();
+	}
+
+	// rgb8 to the byte order of a little-endian BufferedImage.TYPE_INT_RGB pixel
+	if (rgb && (size_t)cw * ch * 4 <= colorPool.get_size())
+	{
+		uint8_t *out = colorPool.begin_write();
+		for (int i = 0, n = cw * ch; i < n; ++i, rgb += 3, out += 4)
+		{
+			out[0] = rgb[2];
+			out[1] = rgb[1];
+			out[2] = rgb[0];
+			out[3] = 0;
+		}
+		colorPool.end_write();
+	}
+}
+
+static jobjectArray wrapPool(JNIEnv *env, frame_pool & pool)
+{
+	jclass byteBuffer = env->FindClass("java/nio/ByteBuffer");
+	jobjectArray array = env->NewObjectArray(frame_pool::SLOTS, byteBuffer, 0);
+	for (int i = 0; i < frame_pool::SLOTS; ++i)
+		env->SetObjectArrayElement(array, i, env->NewDirectByteBuffer(pool.data(i), (jlong)pool.get_size()));
+	return array;
+}
+
+extern "C" {
+
+// Only the first successful call does anything: Java holds ByteBuffers over the pools from then on, so they are
+// never reallocated.
+JNIEXPORT jboolean JNICALL Java_PointerLib_init(JNIEnv *, jclass)
+{
+	if (initialized) return JNI_TRUE;
+
+	// the Java side shows the color frames the hook copies, so color has to be on from the start.
+	pointerSubscribe(POINTER_PRODUCT_HAND | POINTER_PRODUCT_REGISTERED_COLOR);
+	// the pools and the sizes Java reads below are for the mode the device opens in, so it has to stay in it, as
+	// for pointerServe.
+	pointerSetLatencyBudget(0);
+	state *s = initializePointerLib();
+	if (!s) return JNI_FALSE;
+
+	depthWidth = s->depth_intrin.width;
+	depthHeight = s->depth_intrin.height;
+	colorWidth = colorHeight = 0;
+	if (s->dev->is_stream_enabled(rs::stream::color))
+	{
+		const rs::intrinsics color = s->dev->get_stream_intrinsics(rs::stream::color);
+		colorWidth = color.width;
+		colorHeight = color.height;
+	}
+	depthPool.allocate((size_t)depthWidth * depthHeight * 2);
+	colorPool.allocate((size_t)colorWidth * colorHeight * 4);
+	pointerSetFrameHook(copyFrames, 0);
+	initialized = true;
+	return JNI_TRUE;
+}
+
+JNIEXPORT jboolean JNICALL Java_PointerLib_start(JNIEnv *, jclass)
+{
+	return pointerStart();
+}
+
+JNIEXPORT void JNICALL Java_PointerLib_stop(JNIEnv *, jclass)
+{
+	pointerStop();
+}
+
+JNIEXPORT void JNICALL Java_PointerLib_setFilter(JNIEnv *, jclass, jint mode, jfloat a, jfloat b)
+{
+	pointerSetFilter(mode, a, b);
+}
+
+JNIEXPORT jboolean JNICALL Java_PointerLib_waitEvents(JNIEnv *, jclass, jint timeoutMs)
+{
+	return pointerWaitEvents(timeoutMs);
+}
+
+// ints gets INT_STRIDE values per event (type, sequence, hand, gesture), floats FLOAT_STRIDE (px, py, x, y, z,
+// distance) and times one; as many events are drained as all three arrays have room for.
+JNIEXPORT jint JNICALL Java_PointerLib_drainEvents(JNIEnv *env, jclass, jintArray ints, jfloatArray floats, jdoubleArray times)
+{
+	int max = std::min(env->GetArrayLength(ints) / 4, env->GetArrayLength(floats) / 6);
+	max = std::min(max, std::min(env->GetArrayLength(times), (jsize)(sizeof(events) / sizeof(events[0]))));
+	const int n = pointerDrainEvents(events, max);
+	if (n <= 0) return 0;
+
+	jint *i = (jint *)env->GetPrimitiveArrayCritical(ints, 0);
+	jfloat *f = (jfloat *)env->GetPrimitiveArrayCritical(floats, 0);
+	jdouble *t = (jdouble *)env->GetPrimitiveArrayCritical(times, 0);
+	for (int e = 0; e < n; ++e, i += 4, f += 6)
+	{
+		const pointer_event & ev = events[e];
+		i[0] = ev.type;
+		i[1] = (jint)ev.sequence;
+		i[2] = ev.hand;
+		i[3] = ev.gesture;
+		f[0] = ev.px;
+		f[1] = ev.py;
+		f[2] = ev.x;
+		f[3] = ev.y;
+		f[4] = ev.z;
+		f[5] = ev.distance;
+		t[e] = ev.timestamp;
+	}
+	env->ReleasePrimitiveArrayCritical(times, t, 0);
+	env->ReleasePrimitiveArrayCritical(floats, f - 6 * n, 0);
+	env->ReleasePrimitiveArrayCritical(ints, i - 4 * n, 0);
+	return n;
+}
+
+JNIEXPORT jobjectArray JNICALL Java_PointerLib_depthBuffers(JNIEnv *env, jclass)
+{
+	return wrapPool(env, depthPool);
+}
+
+JNIEXPORT jobjectArray JNICALL Java_PointerLib_colorBuffers(JNIEnv *env, jclass)
+{
+	return wrapPool(env, colorPool);
+}
+
+JNIEXPORT jint JNICALL Java_PointerLib_acquireDepth(JNIEnv *, jclass) { return depthPool.acquire(); }
+JNIEXPORT void JNICALL Java_PointerLib_releaseDepth(JNIEnv *, jclass) { depthPool.release(); }
+JNIEXPORT jint JNICALL Java_PointerLib_acquireColor(JNIEnv *, jclass) { return colorPool.acquire(); }
+JNIEXPORT void JNICALL Java_PointerLib_releaseColor(JNIEnv *, jclass) { colorPool.release(); }
+
+JNIEXPORT jint JNICALL Java_PointerLib_depthWidth(JNIEnv *, jclass) { return depthWidth; }
+JNIEXPORT jint JNICALL Java_PointerLib_depthHeight(JNIEnv *, jclass) { return depthHeight; }
+JNIEXPORT jint JNICALL Java_PointerLib_colorWidth(JNIEnv *, jclass) { return colorWidth; }
+JNIEXPORT jint JNICALL Java_PointerLib_colorHeight(JNIEnv *, jclass) { return colorHeight; }
+
+}
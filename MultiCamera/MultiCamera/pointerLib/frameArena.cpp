@@ -0,0 +1,153 @@
+#include "frameArena.h"
+#include <cassert>
+#include <cstdlib>
+#include <new>
+
+frame_arena::frame_arena() : base(), capacity(), used(), demand(), overflow_count(), live()
+{
+}
+
+frame_arena::~frame_arena()
+{
+	for (void * p : overflow) std::free(p);
+}
+
+void frame_arena::reserve(size_t bytes)
+{
+	if (bytes <= capacity) return;
+	assert(used == 0 && "frame_arena::reserve during a frame");
+	storage.resize(bytes + ALIGNMENT);
+	base = storage.data() + (ALIGNMENT - (uintptr_t)storage.data() % ALIGNMENT) % ALIGNMENT;
+	capacity = bytes;
+}
+
+void frame_arena::reset()
+{
+	assert(live == 0 && "a cv::Mat from the frame arena outlived its frame");
+	for (void * p : overflow) std::free(p);
+	overflow.clear();
+	const size_t needed = demand;
+	used = 0;
+	demand = 0;
+	reserve(needed);
+}
+
+void * frame_arena::allocate(size_t bytes)
+{
+	bytes = (bytes + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	demand += bytes;
+	if (used + bytes <= capacity)
+	{
+		void * p = base + used;
+		used += bytes;
+		return p;
+	}
+
+	// Doesn't fit this frame; reset() will grow the arena to the total asked for.
+	++overflow_count;
+	if (overflow.capacity() == overflow.size()) overflow.reserve(overflow.size() * 2 + 8);
+	uint8_t * p = (uint8_t *)std::malloc(bytes + ALIGNMENT);
+	if (!p) throw std::bad_alloc();
+	overflow.push_back(p);
+	return p + (ALIGNMENT - (uintptr_t)p % ALIGNMENT) % ALIGNMENT;
+}
+
+#if CV_MAJOR_VERSION >= 3
+// Same layout as OpenCV's own allocator, but the buffer and its UMatData both come from the arena, so there is
+// nothing to free: deallocate only ends the UMatData's lifetime.
+cv::UMatData * arena_mat_allocator::allocate(int dims, const int * sizes, int type, void * data, size_t * step, int, cv::UMatUsageFlags) const
+{
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; --i)
+	{
+		if (step)
+		{
+			if (data && step[i] != CV_AUTOSTEP)
+			{
+				CV_Assert(total <= step[i]);
+				total = step[i];
+			}
+			else step[i] = total;
+		}
+		total *= sizes[i];
+	}
+
+	cv::UMatData * u = new (arena.allocate(sizeof(cv::UMatData))) cv::UMatData(this);
+	u->data = u->origdata = data ? (uchar *)data : (uchar *)arena.allocate(total);
+	u->size = total;
+	if (data) u->flags |= cv::UMatData::USER_ALLOCATED;
+	arena.mat_allocated();
+	return u;
+}
+
+bool arena_mat_allocator::allocate(cv::UMatData * data, int, cv::UMatUsageFlags) const
+{
+	return data != 0;
+}
+
+void arena_mat_allocator::deallocate(cv::UMatData * data) const
+{
+	if (!data) return;
+	CV_Assert(data->urefcount == 0 && data->refcount == 0);
+	data->~UMatData();
+	arena.mat_released();
+}
+#else
+void arena_mat_allocator::allocate(int dims, const int * sizes, int type, int *& refcount, uchar *& datastart, uchar *& data, size_t * step)
+{
+	size_t total = CV_ELEM_SIZE(type);
+	for (int i = dims - 1; i >= 0; --i)
+	{
+		step[i] = total;
+		total *= sizes[i];
+	}
+	// the reference count goes right after the pixels
+	const size_t refcount_offset = (total + sizeof(int) - 1) & ~(sizeof(int) - 1);
+	datastart = data = (uchar *)arena.allocate(refcount_offset + sizeof(int));
+	refcount = (int *)(data + refcount_offset);
+	*refcount = 1;
+	arena.mat_allocated();
+}
+
+void arena_mat_allocator::deallocate(int *, uchar *, uchar *)
+{
+	arena.mat_released();
+}
+#endif
+
+#ifdef _DEBUG
+// Counting replacement for the global operator new, so the detection path can check that it stays off the heap.
+static thread_local unsigned long long heapAllocations = 0;
+
+unsigned long long heap_allocation_count()
+{
+	return heapAllocations;
+}
+
+void * operator new(size_t size)
+{
+	++heapAllocations;
+	if (void * p = std::malloc(size ? size : 1)) return p;
+	throw std::bad_alloc();
+}
+
+void * operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void operator delete(void * p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete[](void * p) noexcept
+{
+	std::free(p);
+}
+#else
+unsigned long long heap_allocation_count()
+{
+	return 0;
+}
+#endif
@@ -0,0 +1,66 @@
+#pragma once
+#include <opencv2/core/core.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Frame-scoped memory for the detection path: a bump allocator that is reset at the start of every frame, so
+// per-frame buffers cost a pointer increment instead of a trip through the heap. Anything taken from it is
+// only valid until the next reset(). It belongs to the thread running the detection and is not thread safe.
+//
+// A request that does not fit still succeeds, from the heap, and is freed at the next reset(); reset() then
+// grows the arena to the frame's total so the following frames fit again.
+class frame_arena
+{
+	std::vector<uint8_t> storage;
+	uint8_t * base;
+	size_t capacity, used, demand;
+	std::vector<void *> overflow;
+	unsigned long long overflow_count;
+	int live;   // cv::Mats from arena_mat_allocator not yet released
+public:
+	static const size_t ALIGNMENT = 64;
+
+	frame_arena();
+	~frame_arena();
+
+	// Makes room for bytes per frame; only call it between frames.
+	void reserve(size_t bytes);
+	// Starts a new frame. Every cv::Mat taken from the arena must have been released by now.
+	void reset();
+
+	void * allocate(size_t bytes);
+	template<class T> T * allocate(size_t count) { return (T *)allocate(count * sizeof(T)); }
+
+	size_t get_capacity() const { return capacity; }
+	size_t get_used() const { return used; }
+	// requests that went to the heap since the arena was created; constant once the arena is warm.
+	unsigned long long get_overflow_count() const { return overflow_count; }
+
+	void mat_allocated() { ++live; }
+	void mat_released() { --live; }
+	int get_live_mats() const { return live; }
+};
+
+// Lets cv::Mat data live in a frame_arena: set a Mat's allocator to it before create() (or before passing it
+// to an OpenCV function as output) and the data comes from the arena. The Mat must be released before the
+// arena is reset, so use it for locals of the frame only.
+class arena_mat_allocator : public cv::MatAllocator
+{
+	frame_arena & arena;
+public:
+	explicit arena_mat_allocator(frame_arena & a) : arena(a) {}
+
+#if CV_MAJOR_VERSION >= 3
+	cv::UMatData * allocate(int dims, const int * sizes, int type, void * data, size_t * step, int flags, cv::UMatUsageFlags usageFlags) const;
+	bool allocate(cv::UMatData * data, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+	void deallocate(cv::UMatData * data) const;
+#else
+	void allocate(int dims, const int * sizes, int type, int *& refcount, uchar *& datastart, uchar *& data, size_t * step);
+	void deallocate(int * refcount, uchar * datastart, uchar * data);
+#endif
+};
+
+// Number of times this thread has called operator new. Only counted in _DEBUG builds, where pointerLib
+// replaces the global operator new; always 0 otherwise.
+unsigned long long heap_allocation_count();
@@ -0,0 +1,333 @@
+#include "gestureEngine.h"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+
+// resamples a path to gesture_engine::LENGTH points evenly spaced along its length.
+static void resample(const std::vector<float> & x, const std::vector<float> & y, const std::vector<float> & z,
+	std::vector<float> & ox, std::vector<float> & oy, std::vector<float> & oz)
+{
+	const int n = (int)x.size(), length = gesture_engine::LENGTH;
+	std::vector<float> dist(n, 0.0f);
+	for (int i = 1; i < n; ++i)
+	{
+		const float dx = x[i] - x[i - 1], dy = y[i] - y[i - 1], dz = z[i] - z[i - 1];
+		dist[i] = dist[i - 1] + std::sqrt(dx * dx + dy * dy + dz * dz);
+	}
+
+	ox.resize(length);
+	oy.resize(length);
+	oz.resize(length);
+	int seg = 1;
+	for (int k = 0; k < length; ++k)
+	{
+		const float target = dist[n - 1] * k / (length - 1);
+		while (seg < n - 1 && dist[seg] < target) ++seg;
+		const float span = dist[seg] - dist[seg - 1];
+		const float f = span > 0 ? std::min(1.0f, std::max(0.0f, (target - dist[seg - 1]) / span)) : 0.0f;
+		ox[k] = x[seg - 1] + (x[seg] - x[seg - 1]) * f;
+		oy[k] = y[seg - 1] + (y[seg] - y[seg - 1]) * f;
+		oz[k] = z[seg - 1] + (z[seg] - z[seg - 1]) * f;
+	}
+}
+
+const float gesture_engine::MIN_GESTURE_SPEED = 0.3f;
+
+gesture_engine::gesture_engine() : event_head(0), event_count(0), threshold(0.012f), refractory_seconds(0.5), min_extent(0.08f)
+{
+	window_seconds[0] = 0.6;
+	window_seconds[1] = 1.2;
+	for (int h = 0; h < HANDS; ++h)
+	{
+		hands[h].head = hands[h].count = 0;
+		hands[h].last_event = -1e9;
+		hands[h].peak_speed = 0;
+	}
+}
+
+// centres the path on its centroid and scales its largest bounding box side to 1.
+bool gesture_engine::normalize(std::vector<float> & x, std::vector<float> & y, std::vector<float> & z, float min_extent)
+{
+	float cx = 0, cy = 0, cz = 0;
+	float lo[3] = { 1e30f, 1e30f, 1e30f }, hi[3] = { -1e30f, -1e30f, -1e30f };
+	const int n = (int)x.size();
+	for (int i = 0; i < n; ++i)
+	{
+		cx += x[i]; cy += y[i]; cz += z[i];
+		lo[0] = std::min(lo[0], x[i]); hi[0] = std::max(hi[0], x[i]);
+		lo[1] = std::min(lo[1], y[i]); hi[1] = std::max(hi[1], y[i]);
+		lo[2] = std::min(lo[2], z[i]); hi[2] = std::max(hi[2], z[i]);
+	}
+	const float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+	if (extent <= 0 || extent < min_extent) return false;
+
+	cx /= n; cy /= n; cz /= n;
+	for (int i = 0; i < n; ++i)
+	{
+		x[i] = (x[i] - cx) / extent;
+		y[i] = (y[i] - cy) / extent;
+		z[i] = (z[i] - cz) / extent;
+	}
+	return true;
+}
+
+int gesture_engine::add_template(int type, const float * x, const float * y, const float * z, int n)
+{
+	// resampling interpolates between consecutive points, so a path needs two of them.
+	if (n < 2) return -1;
+	std::vector<float> px(x, x + n), py(y, y + n), pz(z, z + n), rx, ry, rz;
+	resample(px, py, pz, rx, ry, rz);
+	normalize(rx, ry, rz, 0);
+
+	const int id = (int)types.size(), lane = id % LANES;
+	if (lane == 0)
+	{
+		// unused lanes of a new block hold a far-away path so they never match.
+		template_block b;
+		for (int k = 0; k < LENGTH; ++k)
+			for (int l = 0; l < LANES; ++l)
+				b.x[k][l] = b.y[k][l] = b.z[k][l] = 1e3f;
+		blocks.push_back(b);
+	}
+
+	template_block & b = blocks.back();
+	for (int k = 0; k < LENGTH; ++k)
+	{
+		b.x[k][lane] = rx[k];
+		b.y[k][lane] = ry[k];
+		b.z[k][lane] = rz[k];
+	}
+	types.push_back(type);
+	return id;
+}
+
+void gesture_engine::add_default_templates()
+{
+	// camera coordinates: x right, y down, z away from the camera.
+	const int n = 16;
+	float x[n], y[n], z[n];
+	const float pi = 3.14159265f;
+
+	// swipes, straight and bowed either way, each also tilted a little either way
+	const float dirs[4][2] = { { -1, 0 }, { 1, 0 }, { 0, -1 }, { 0, 1 } };
+	const int swipeTypes[4] = { GESTURE_SWIPE_LEFT, GESTURE_SWIPE_RIGHT, GESTURE_SWIPE_UP, GESTURE_SWIPE_DOWN };
+	for (int d = 0; d < 4; ++d)
+	{
+		for (int tilt = -1; tilt <= 1; ++tilt)
+		{
+			const float c = std::cos(0.25f * tilt), sn = std::sin(0.25f * tilt);
+			const float dx = c * dirs[d][0] - sn * dirs[d][1], dy = sn * dirs[d][0] + c * dirs[d][1];
+			for (int bow = -1; bow <= 1; ++bow)
+			{
+				for (int i = 0; i < n; ++i)
+				{
+					const float s = (float)i / (n - 1), b = 0.15f * bow * std::sin(pi * s);
+					x[i] = dx * s - dy * b;
+					y[i] = dy * s + dx * b;
+					z[i] = 0;
+				}
+				add_template(swipeTypes[d], x, y, z, n);
+			}
+		}
+	}
+
+	// full circles in the image plane, round or flattened, starting at each quarter
+	for (int dir = 0; dir < 2; ++dir)
+	{
+		for (int flat = 0; flat < 2; ++flat)
+		{
+			for (int start = 0; start < 4; ++start)
+			{
+				for (int i = 0; i < n; ++i)
+				{
+					const float a = start * pi / 2 + (dir == 0 ? 1 : -1) * 2 * pi * i / (n - 1);
+					x[i] = std::cos(a);
+					y[i] = (flat ? 0.6f : 1.0f) * std::sin(a);
+					z[i] = 0;
+				}
+				add_template(dir == 0 ? GESTURE_CIRCLE_CW : GESTURE_CIRCLE_CCW, x, y, z, n);
+			}
+		}
+	}
+
+	// push towards / pull away from the camera, straight or drifting slightly down
+	for (int dir = 0; dir < 2; ++dir)
+	{
+		for (int drift = 0; drift < 3; ++drift)
+		{
+			for (int i = 0; i < n; ++i)
+			{
+				const float s = (float)i / (n - 1);
+				x[i] = 0;
+				y[i] = 0.2f * drift * s;
+				z[i] = dir == 0 ? -s : s;
+			}
+			add_template(dir == 0 ? GESTURE_PUSH : GESTURE_PULL, x, y, z, n);
+		}
+	}
+}
+
+void gesture_engine::dtw_block(const float * qx, const float * qy, const float * qz, const template_block & b, float out[LANES]) const
+{
+#ifdef MR_SSE2
+	const __m128 inf = _mm_set1_ps(1e30f);
+	__m128 rows[2][LENGTH + 1];
+	__m128 * prev = rows[0], * cur = rows[1];
+	for (int j = 0; j <= LENGTH; ++j) prev[j] = inf;
+	prev[0] = _mm_setzero_ps();
+
+	for (int i = 1; i <= LENGTH; ++i)
+	{
+		for (int j = 0; j <= LENGTH; ++j) cur[j] = inf;
+		const __m128 x = _mm_set1_ps(qx[i - 1]), y = _mm_set1_ps(qy[i - 1]), z = _mm_set1_ps(qz[i - 1]);
+		const int lo = std::max(1, i - BAND), hi = std::min(LENGTH, i + BAND);
+		for (int j = lo; j <= hi; ++j)
+		{
+			const __m128 dx = _mm_sub_ps(x, _mm_loadu_ps(b.x[j - 1]));
+			const __m128 dy = _mm_sub_ps(y, _mm_loadu_ps(b.y[j - 1]));
+			const __m128 dz = _mm_sub_ps(z, _mm_loadu_ps(b.z[j - 1]));
+			const __m128 cost = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			cur[j] = _mm_add_ps(cost, _mm_min_ps(_mm_min_ps(prev[j], cur[j - 1]), prev[j - 1]));
+		}
+		std::swap(prev, cur);
+	}
+	_mm_storeu_ps(out, _mm_div_ps(prev[LENGTH], _mm_set1_ps((float)LENGTH)));
+#else
+	for (int l = 0; l < LANES; ++l)
+	{
+		float rows[2][LENGTH + 1];
+		float * prev = rows[0], * cur = rows[1];
+		for (int j = 0; j <= LENGTH; ++j) prev[j] = 1e30f;
+		prev[0] = 0;
+		for (int i = 1; i <= LENGTH; ++i)
+		{
+			for (int j = 0; j <= LENGTH; ++j) cur[j] = 1e30f;
+			const int lo = std::max(1, i - BAND), hi = std::min(LENGTH, i + BAND);
+			for (int j = lo; j <= hi; ++j)
+			{
+				const float dx = qx[i - 1] - b.x[j - 1][l], dy = qy[i - 1] - b.y[j - 1][l], dz = qz[i - 1] - b.z[j - 1][l];
+				cur[j] = dx * dx + dy * dy + dz * dz + std::min(std::min(prev[j], cur[j - 1]), prev[j - 1]);
+			}
+			std::swap(prev, cur);
+		}
+		out[l] = prev[LENGTH] / LENGTH;
+	}
+#endif
+}
+
+// matches the path of the last window seconds of a hand; returns the best distance and template.
+float gesture_engine::match(int hand, double window, int & best)
+{
+	const hand_history & h = hands[hand];
+	const double now = h.ring[(h.head - 1 + HISTORY) % HISTORY].t;
+
+	int n = 0;
+	while (n < h.count && now - h.ring[(h.head - 1 - n + HISTORY) % HISTORY].t <= window) ++n;
+	best = -1;
+	if (n < 8) return 1e30f;
+
+	std::vector<float> x(n), y(n), z(n);
+	for (int i = 0; i < n; ++i)
+	{
+		const sample & s = h.ring[(h.head - n + i + HISTORY) % HISTORY];
+		x[i] = s.x;
+		y[i] = s.y;
+		z[i] = s.z;
+	}
+
+	std::vector<float> rx, ry, rz;
+	resample(x, y, z, rx, ry, rz);
+	if (!normalize(rx, ry, rz, min_extent)) return 1e30f;
+
+	float bestDistance = 1e30f;
+	for (size_t b = 0; b < blocks.size(); ++b)
+	{
+		float d[LANES];
+		dtw_block(rx.data(), ry.data(), rz.data(), blocks[b], d);
+		for (int l = 0; l < LANES && b * LANES + l < types.size(); ++l)
+		{
+			if (d[l] < bestDistance)
+			{
+				bestDistance = d[l];
+				best = (int)(b * LANES + l);
+			}
+		}
+	}
+	return bestDistance;
+}
+
+// the hand has come to rest (or left): match its path over every window, emit the best match, start over.
+void gesture_engine::segment(int hand)
+{
+	hand_history & h = hands[hand];
+	if (!h.count) return;
+	const double now = h.ring[(h.head - 1 + HISTORY) % HISTORY].t;
+
+	if (now - h.last_event >= refractory_seconds)
+	{
+		int best = -1;
+		float bestDistance = threshold;
+		for (int w = 0; w < 2; ++w)
+		{
+			int id;
+			const float d = match(hand, window_seconds[w], id);
+			if (id >= 0 && d < bestDistance)
+			{
+				bestDistance = d;
+				best = id;
+			}
+		}
+		if (best >= 0)
+		{
+			// nobody may be polling, so a full ring drops its oldest event rather than growing.
+			gesture_event e = { types[best], best, hand, bestDistance, now };
+			events[(event_head + event_count) % EVENTS] = e;
+			if (event_count < EVENTS) ++event_count;
+			else event_head = (event_head + 1) % EVENTS;
+			h.last_event = now;
+		}
+	}
+
+	// keep only the newest sample so the next path starts where the hand is now.
+	h.count = 1;
+	h.peak_speed = 0;
+}
+
+void gesture_engine::add_sample(int hand, float x, float y, float z, double t)
+{
+	hand_history & h = hands[hand];
+	sample & s = h.ring[h.head];
+	s.x = x;
+	s.y = y;
+	s.z = z;
+	s.t = t;
+	h.head = (h.head + 1) % HISTORY;
+	h.count = std::min(h.count + 1, HISTORY);
+
+	// speed over roughly the last 100 ms
+	int back = 1;
+	while (back < h.count - 1 && t - h.ring[(h.head - 1 - back + HISTORY) % HISTORY].t < 0.1) ++back;
+	if (back >= h.count) return;
+	const sample & o = h.ring[(h.head - 1 - back + HISTORY) % HISTORY];
+	if (t <= o.t) return;
+	const float dx = x - o.x, dy = y - o.y, dz = z - o.z;
+	const float speed = std::sqrt(dx * dx + dy * dy + dz * dz) / (float)(t - o.t);
+
+	h.peak_speed = std::max(h.peak_speed, speed);
+	if (h.peak_speed > MIN_GESTURE_SPEED && speed < h.peak_speed * 0.25f) segment(hand);
+}
+
+void gesture_engine::lose_hand(int hand)
+{
+	segment(hand);
+	hands[hand].count = 0;
+}
+
+int gesture_engine::poll(gesture_event * out, int max)
+{
+	const int n = std::max(0, std::min(max, event_count));
+	for (int i = 0; i < n; ++i) out[i] = events[(event_head + i) % EVENTS];
+	event_head = (event_head + n) % EVENTS;
+	event_count -= n;
+	return n;
+}
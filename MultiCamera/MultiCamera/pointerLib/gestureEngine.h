@@ -0,0 +1,94 @@
+#pragma once
+#include <vector>
+
+// Trajectory gesture recognition: the recent path of each tracked hand is matched against a library of
+// template paths with banded dynamic time warping (DTW).
+
+enum gesture_type
+{
+	GESTURE_SWIPE_LEFT = 0,
+	GESTURE_SWIPE_RIGHT = 1,
+	GESTURE_SWIPE_UP = 2,
+	GESTURE_SWIPE_DOWN = 3,
+	GESTURE_CIRCLE_CW = 4,
+	GESTURE_CIRCLE_CCW = 5,
+	GESTURE_PUSH = 6,
+	GESTURE_PULL = 7,
+	GESTURE_CUSTOM = 8
+};
+
+struct gesture_event
+{
+	int type;          // gesture_type
+	int template_id;   // index into the engine's template library
+	int hand;
+	float distance;    // mean squared DTW distance of the normalized paths, lower is better
+	double timestamp;  // seconds, time of the last sample of the matched path
+};
+
+class gesture_engine
+{
+public:
+	static const int HANDS = 2;
+	static const int HISTORY = 128;    // samples kept per hand
+	static const int LENGTH = 32;      // points every path is resampled to before matching
+	static const int BAND = 4;         // Sakoe-Chiba band half-width
+	static const int LANES = 4;        // templates matched at once
+	static const int EVENTS = 64;      // pending events kept for poll(); the oldest is dropped beyond that
+	static const float MIN_GESTURE_SPEED;  // meters/second a hand must reach before its path is matched
+private:
+	struct sample { float x, y, z; double t; };
+	struct hand_history
+	{
+		sample ring[HISTORY];
+		int head, count;
+		double last_event;
+		float peak_speed;  // fastest the hand has moved since its path was last cleared
+	};
+
+	// Templates are stored in blocks of LANES, interleaved per point so one SSE load fetches the same
+	// coordinate of four templates.
+	struct template_block
+	{
+		float x[LENGTH][LANES], y[LENGTH][LANES], z[LENGTH][LANES];
+	};
+
+	hand_history hands[HANDS];
+	std::vector<template_block> blocks;
+	std::vector<int> types;
+	gesture_event events[EVENTS];      // ring of pending events, oldest at event_head
+	int event_head, event_count;
+	float threshold;
+	double window_seconds[2];
+	double refractory_seconds;
+	float min_extent;
+
+	static bool normalize(std::vector<float> & x, std::vector<float> & y, std::vector<float> & z, float min_extent);
+	float match(int hand, double window, int & best);
+	void segment(int hand);
+	void dtw_block(const float * qx, const float * qy, const float * qz, const template_block & b, float out[LANES]) const;
+public:
+	gesture_engine();
+
+	// Adds a template from a path of n >= 2 points (any length, any scale); returns its id, or -1 for a shorter path.
+	int add_template(int type, const float * x, const float * y, const float * z, int n);
+	void add_default_templates();
+	int get_template_count() const { return (int)types.size(); }
+
+	// distance threshold for a match, window lengths tried (seconds), time after a match during which the hand
+	// is not matched again, and the smallest path extent (meters) that can count as a gesture.
+	void set_threshold(float t) { threshold = t; }
+	void set_windows(double shortest, double longest) { window_seconds[0] = shortest; window_seconds[1] = longest; }
+	void set_refractory(double seconds) { refractory_seconds = seconds; }
+	void set_min_extent(float meters) { min_extent = meters; }
+
+	// Appends a position (meters) of a hand at time t (seconds). Once the hand slows down after moving, its recent
+	// path is matched and cleared.
+	void add_sample(int hand, float x, float y, float z, double t);
+	// The hand left the view: match what it did last, then forget it.
+	void lose_hand(int hand);
+
+	// Copies up to max pending events into out, oldest first, and removes them; returns how many were copied.
+	// Only the newest EVENTS are kept between calls.
+	int poll(gesture_event * out, int max);
+};
@@ -0,0 +1,180 @@
+#include "handGeometry.h"
+#include "simd.hpp"
+#include <algorithm>
+#include <cmath>
+
+static const uint16_t FAR_AWAY = 0x3fff;
+
+hand_geometry::hand_geometry() : tip_factor(1.6f), border(3)
+{
+}
+
+// Two-pass 3-4 chamfer transform of the blob's bounding box. The terms from the row above (or below) are
+// already final, so they are applied eight pixels at a time; only the left (or right) neighbor is a serial
+// dependency. Sets best to the padded index of the largest distance and area to the blob's pixel count.
+void hand_geometry::transform(const uint8_t * mask, int stride, int x0, int y0, int w, int h, uint8_t value, int & best, int & area)
+{
+	const int pw = w + 2, ph = h + 2;
+	distance.assign(pw * ph, 0);
+	area = 0;
+	for (int y = 0; y < h; ++y)
+	{
+		const uint8_t * m = mask + (y0 + y) * stride + x0;
+		uint16_t * d = distance.data() + (y + 1) * pw + 1;
+		for (int x = 0; x < w; ++x)
+		{
+			const bool inside = m[x] == value;
+			d[x] = inside ? FAR_AWAY : 0;
+			area += inside;
+		}
+	}
+
+	for (int y = 1; y <= h; ++y)
+	{
+		uint16_t * d = distance.data() + y * pw;
+		const uint16_t * up = d - pw;
+		int x = 1;
+#ifdef MR_SSE2
+		const __m128i three = _mm_set1_epi16(3), four = _mm_set1_epi16(4);
+		for (; x + 8 <= w + 1; x += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(d + x));
+			v = _mm_min_epi16(v, _mm_adds_epu16(_mm_loadu_si128((const __m128i *)(up + x - 1)), four));
+			v = _mm_min_epi16(v, _mm_adds_epu16(_mm_loadu_si128((const __m128i *)(up + x)), three));
+			v = _mm_min_epi16(v, _mm_adds_epu16(_mm_loadu_si128((const __m128i *)(up + x + 1)), four));
+			_mm_storeu_si128((__m128i *)(d + x), v);
+		}
+#endif
+		for (; x <= w; ++x)
+			d[x] = std::min<uint16_t>(d[x], std::min(std::min(up[x - 1], up[x + 1]) + 4, up[x] + 3));
+		for (x = 1; x <= w; ++x)
+			d[x] = std::min<uint16_t>(d[x], d[x - 1] + 3);
+	}
+
+	best = 0;
+	uint16_t peak = 0;
+	for (int y = h; y >= 1; --y)
+	{
+		uint16_t * d = distance.data() + y * pw;
+		const uint16_t * down = d + pw;
+		int x = 1;
+#ifdef MR_SSE2
+		const __m128i three = _mm_set1_epi16(3), four = _mm_set1_epi16(4);
+		for (; x + 8 <= w + 1; x += 8)
+		{
+			__m128i v = _mm_loadu_si128((const __m128i *)(d + x));
+			v = _mm_min_epi16(v, _mm_adds_epu16(_mm_loadu_si128((const __m128i *)(down + x - 1)), four));
+			v = _mm_min_epi16(v, _mm_adds_epu16(_mm_loadu_si128((const __m128i *)(down + x)), three));
+			v = _mm_min_epi16(v, _mm_adds_epu16(_mm_loadu_si128((const __m128i *)(down + x + 1)), four));
+			_mm_storeu_si128((__m128i *)(d + x), v);
+		}
+#endif
+		for (; x <= w; ++x)
+			d[x] = std::min<uint16_t>(d[x], std::min(std::min(down[x - 1], down[x + 1]) + 4, down[x] + 3));
+		for (x = w; x >= 1; --x)
+		{
+			d[x] = std::min<uint16_t>(d[x], d[x + 1] + 3);
+			if (d[x] > peak)
+			{
+				peak = d[x];
+				best = y * pw + x;
+			}
+		}
+	}
+}
+
+// Pseudo-angle of (dx, dy) on the diamond |dx| + |dy| = 1, mapped to a bin. Monotonic in the true angle, which
+// is all the binning needs, and avoids an atan2 per contour pixel.
+int hand_geometry::angle_bin(int dx, int dy)
+{
+	const float sum = (float)(std::abs(dx) + std::abs(dy));
+	float a;
+	if (dy >= 0) a = dx >= 0 ? dy / sum : 2 - dy / sum;
+	else a = dx < 0 ? 2 - dy / sum : 4 + dy / sum;
+	return std::min(BINS - 1, (int)(a * (BINS / 4)));
+}
+
+bool hand_geometry::process(const uint8_t * mask, int stride, int image_width, int image_height, int x0, int y0, int w, int h, uint8_t value,
+	const uint16_t * depth, const rs::intrinsics & intrin, float scale, hand_record & hand)
+{
+	hand = hand_record();
+	hand.pointer_tip = -1;
+	if (w <= 0 || h <= 0) return false;
+
+	int best, area;
+	transform(mask, stride, x0, y0, w, h, value, best, area);
+	if (!area) return false;
+
+	const int pw = w + 2;
+	const int cx = best % pw - 1 + x0, cy = best / pw - 1 + y0;
+	const float radius = distance[best] / 3.0f;
+	hand.valid = 1;
+	hand.area = area;
+	hand.roi_x = x0;
+	hand.roi_y = y0;
+	hand.roi_width = w;
+	hand.roi_height = h;
+	hand.palm_px = (float)cx;
+	hand.palm_py = (float)cy;
+	hand.palm_radius = radius;
+	const rs::float3 palm = intrin.deproject({ (float)cx, (float)cy }, depth[cy * image_width + cx] * scale);
+	hand.palm_x = palm.x;
+	hand.palm_y = palm.y;
+	hand.palm_z = palm.z;
+
+	// The contour is every blob pixel next to the background (distance 3 or 4). Keep the farthest contour
+	// point from the palm center in each angular bin, and mark the bins where the blob runs into the image edge.
+	for (int b = 0; b < BINS; ++b) bins[b] = { 0, 0, 0, false };
+	for (int y = 0; y < h; ++y)
+	{
+		const int iy = y0 + y;
+		const bool edge_row = iy < border || iy >= image_height - border;
+		const uint16_t * d = distance.data() + (y + 1) * pw + 1;
+		for (int x = 0; x < w; ++x)
+		{
+			if (d[x] == 0 || d[x] > 4) continue;
+			const int ix = x0 + x, dx = ix - cx, dy = iy - cy, dist2 = dx * dx + dy * dy;
+			if (!dist2) continue;
+			bin & b = bins[angle_bin(dx, dy)];
+			if (edge_row || ix < border || ix >= image_width - border) b.cut = true;
+			if (dist2 > b.dist2) b = { dist2, ix, iy, b.cut };
+		}
+	}
+
+	// A fingertip is a bin that reaches far enough out, is the farthest among its neighbors and is not cut off
+	// in its own or an adjacent bin. On ties the first bin wins so a flat stretch gives a single tip.
+	const float reach = tip_factor * radius;
+	const int min_dist2 = (int)(reach * reach);
+	int tips[BINS], count = 0;
+	for (int b = 0; b < BINS; ++b)
+	{
+		if (!bins[b].dist2 || bins[b].dist2 < min_dist2) continue;
+		if (bins[b].cut || bins[(b + BINS - 1) % BINS].cut || bins[(b + 1) % BINS].cut) continue;
+		bool peak = true;
+		for (int k = 1; k <= NEIGHBORS && peak; ++k)
+		{
+			peak = bins[(b + BINS - k) % BINS].dist2 < bins[b].dist2 && bins[(b + k) % BINS].dist2 <= bins[b].dist2;
+		}
+		if (peak) tips[count++] = b;
+	}
+	if (count > HAND_MAX_TIPS)
+	{
+		std::partial_sort(tips, tips + HAND_MAX_TIPS, tips + count, [&](int a, int b) { return bins[a].dist2 > bins[b].dist2; });
+		std::sort(tips, tips + HAND_MAX_TIPS);
+		count = HAND_MAX_TIPS;
+	}
+
+	hand.tip_count = count;
+	for (int i = 0; i < count; ++i)
+	{
+		const bin & b = bins[tips[i]];
+		const rs::float3 tip = intrin.deproject({ (float)b.x, (float)b.y }, depth[b.y * image_width + b.x] * scale);
+		hand.tip_px[i] = (float)b.x;
+		hand.tip_py[i] = (float)b.y;
+		hand.tip_x[i] = tip.x;
+		hand.tip_y[i] = tip.y;
+		hand.tip_z[i] = tip.z;
+		if (hand.pointer_tip < 0 || b.y < hand.tip_py[hand.pointer_tip]) hand.pointer_tip = i;
+	}
+	return true;
+}
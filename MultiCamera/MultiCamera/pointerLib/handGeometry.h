@@ -0,0 +1,58 @@
+#pragma once
+#include <librealsense/rs.hpp>
+#include <cstdint>
+#include <vector>
+
+// Hand geometry from a segmented blob: the palm is the largest circle that fits inside the blob, found with a
+// chamfer distance transform, and fingertips are the contour points that stick out farthest from it. All work
+// is confined to the blob's bounding box, so the cost follows the size of the hand, not of the frame.
+
+const int HAND_MAX_TIPS = 5;
+
+struct hand_record
+{
+	int valid;
+	int area;                                  // blob pixels
+	int roi_x, roi_y, roi_width, roi_height;   // blob bounding box, depth pixels
+	float palm_px, palm_py;                    // palm center, depth pixels
+	float palm_radius;                         // depth pixels
+	float palm_x, palm_y, palm_z;              // palm center, meters relative to the depth camera
+	int tip_count;
+	int pointer_tip;                           // the top-most fingertip, -1 if there is none
+	float tip_px[HAND_MAX_TIPS], tip_py[HAND_MAX_TIPS];
+	float tip_x[HAND_MAX_TIPS], tip_y[HAND_MAX_TIPS], tip_z[HAND_MAX_TIPS];
+};
+
+class hand_geometry
+{
+public:
+	static const int BINS = 64;        // angular bins around the palm center the contour is reduced to
+	static const int NEIGHBORS = 2;    // a fingertip is the farthest point within this many bins either side
+private:
+	struct bin { int dist2, x, y; bool cut; };
+
+	std::vector<uint16_t> distance;    // 3-4 chamfer distance of the bounding box plus a one pixel border
+	bin bins[BINS];
+	float tip_factor;
+	int border;
+
+	void transform(const uint8_t * mask, int stride, int x0, int y0, int w, int h, uint8_t value, int & best, int & area);
+	static int angle_bin(int dx, int dy);
+public:
+	hand_geometry();
+
+	// how far from the palm center, in palm radii, a contour point must be to count as a fingertip, and how
+	// close to the image edge (pixels) the blob counts as cut off rather than ended, like an arm leaving the
+	// frame. Directions in which the blob is cut off never hold a fingertip.
+	void set_tip_factor(float radii) { tip_factor = radii; }
+	void set_border(int pixels) { border = pixels; }
+
+	// Makes room for a blob as large as a width x height frame, so process() never allocates afterwards. Call it
+	// whenever the frame size changes.
+	void reserve(int width, int height) { distance.reserve((size_t)(width + 2) * (height + 2)); }
+
+	// mask holds the blob as pixels equal to value, and (x0, y0, w, h) is its bounding box. depth is the z16
+	// frame the mask came from, used for the metric positions. Returns hand.valid.
+	bool process(const uint8_t * mask, int stride, int image_width, int image_height, int x0, int y0, int w, int h, uint8_t value,
+		const uint16_t * depth, const rs::intrinsics & intrin, float scale, hand_record & hand);
+};
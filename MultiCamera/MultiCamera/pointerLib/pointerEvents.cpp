@@ -0,0 +1,87 @@
+#include "pointerEvents.h"
+#include <chrono>
+#include <cmath>
+
+pointer_event_queue::pointer_event_queue()
+	: dropped(0), callback(nullptr), callback_user(nullptr), sequence(0), tracking(false), move_pixels(1.0f), move_meters(0.002f)
+{
+	for (int i = 0; i < 5; ++i) last[i] = 0;
+}
+
+void pointer_event_queue::emit(int type, double timestamp, const float values[5], int gesture, float distance)
+{
+	pointer_event e = { type, sequence++, timestamp, 0, values[0], values[1], values[2], values[3], values[4], gesture, distance };
+	if (callback)
+	{
+		callback(&e, callback_user);
+		return;
+	}
+
+	pointer_event * slot = ring.acquire_write();
+	if (!slot)
+	{
+		// the consumer is CAPACITY events behind; it sees the gap in sequence numbers.
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	*slot = e;
+	ring.commit_write();
+
+	// taking the lock orders the notify after a consumer that is about to sleep, so the wakeup is not lost.
+	{ std::lock_guard<std::mutex> lock(wake_mutex); }
+	wake.notify_one();
+}
+
+void pointer_event_queue::update(bool found, const float values[5], double timestamp)
+{
+	if (!found)
+	{
+		if (tracking) emit(POINTER_EVENT_HAND_LEAVE, timestamp, last, -1, 0);
+		tracking = false;
+		return;
+	}
+
+	if (!tracking)
+	{
+		tracking = true;
+		for (int i = 0; i < 5; ++i) last[i] = values[i];
+		emit(POINTER_EVENT_HAND_ENTER, timestamp, last, -1, 0);
+		return;
+	}
+
+	const float dpx = values[0] - last[0], dpy = values[1] - last[1];
+	const float dx = values[2] - last[2], dy = values[3] - last[3], dz = values[4] - last[4];
+	if (dpx * dpx + dpy * dpy < move_pixels * move_pixels && dx * dx + dy * dy + dz * dz < move_meters * move_meters) return;
+
+	for (int i = 0; i < 5; ++i) last[i] = values[i];
+	emit(POINTER_EVENT_HAND_MOVE, timestamp, last, -1, 0);
+}
+
+void pointer_event_queue::gesture(const gesture_event & g)
+{
+	emit(POINTER_EVENT_GESTURE, g.timestamp * 1000, last, g.type, g.distance);
+}
+
+void pointer_event_queue::reset()
+{
+	tracking = false;
+}
+
+int pointer_event_queue::drain(pointer_event * out, int max)
+{
+	int n = 0;
+	while (n < max)
+	{
+		pointer_event * e = ring.front();
+		if (!e) break;
+		out[n++] = *e;
+		ring.pop();
+	}
+	return n;
+}
+
+bool pointer_event_queue::wait(int timeout_ms)
+{
+	std::unique_lock<std::mutex> lock(wake_mutex);
+	return wake.wait_for(lock, std::chrono::milliseconds(timeout_ms), [this] { return ring.size() > 0; });
+}
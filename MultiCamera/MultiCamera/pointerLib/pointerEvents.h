@@ -0,0 +1,72 @@
+#pragma once
+#include "spsc_ring.hpp"
+#include "gestureEngine.h"
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+
+// Turns the per-frame pointer into a stream of events, so clients only hear about real changes.
+
+enum pointer_event_type
+{
+	POINTER_EVENT_HAND_ENTER = 0,
+	POINTER_EVENT_HAND_MOVE = 1,
+	POINTER_EVENT_HAND_LEAVE = 2,
+	POINTER_EVENT_GESTURE = 3
+};
+
+struct pointer_event
+{
+	int type;               // pointer_event_type
+	unsigned int sequence;  // one more than the previous event produced; a gap means events were dropped
+	double timestamp;       // host capture time in ms
+	int hand;
+	float px, py;           // filtered pointer in depth image pixels (last known position for leave and gesture)
+	float x, y, z;          // the same in meters
+	int gesture;            // gesture_type for POINTER_EVENT_GESTURE, -1 otherwise
+	float distance;         // gesture match distance, 0 otherwise
+};
+
+typedef void (*pointer_event_callback)(const pointer_event * event, void * user);
+
+// Producer side runs on the capture thread; a single consumer drains events in batches or sleeps in wait().
+// When a callback is set it receives every event on the capture thread instead of the queue.
+class pointer_event_queue
+{
+public:
+	static const size_t CAPACITY = 256;
+private:
+	spsc_ring<pointer_event, CAPACITY> ring;
+	std::atomic<unsigned int> dropped;
+	std::mutex wake_mutex;
+	std::condition_variable wake;
+	pointer_event_callback callback;
+	void * callback_user;
+
+	// producer state
+	unsigned int sequence;
+	bool tracking;
+	float last[5];
+	float move_pixels, move_meters;
+
+	void emit(int type, double timestamp, const float values[5], int gesture, float distance);
+public:
+	pointer_event_queue();
+
+	// Not synchronized with the producer: set these before the capture thread starts.
+	void set_callback(pointer_event_callback cb, void * user) { callback = cb; callback_user = user; }
+	void set_move_threshold(float pixels, float meters) { move_pixels = pixels; move_meters = meters; }
+
+	// Producer: the pointer for one frame (px, py, x, y, z), or found = false when there is no hand.
+	void update(bool found, const float values[5], double timestamp);
+	void gesture(const gesture_event & e);
+	// Producer: resets hand state, e.g. when capture stops.
+	void reset();
+
+	// Consumer: copies up to max events into out and returns how many.
+	int drain(pointer_event * out, int max);
+	// Consumer: sleeps until an event is queued or timeout_ms passes; returns whether one is queued.
+	bool wait(int timeout_ms);
+	size_t pending() const { return ring.size(); }
+	unsigned int get_dropped_count() const { return dropped.load(std::memory_order_relaxed); }
+};
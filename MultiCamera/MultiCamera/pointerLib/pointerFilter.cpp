@@ -0,0 +1,124 @@
+#include "pointerFilter.h"
+#include <cmath>
+
+static float smoothing_factor(float cutoff, float dt)
+{
+	const float tau = 1.0f / (2 * 3.14159265f * cutoff);
+	return 1.0f / (1.0f + tau / dt);
+}
+
+one_euro_filter::one_euro_filter(float min_cutoff, float beta, float d_cutoff)
+	: min_cutoff(min_cutoff), beta(beta), d_cutoff(d_cutoff), x_prev(0), dx_prev(0), t_prev(0), initialized(false)
+{
+}
+
+void one_euro_filter::set_params(float mc, float b)
+{
+	if (mc > 0) min_cutoff = mc;
+	if (b >= 0) beta = b;
+}
+
+float one_euro_filter::filter(float x, double t)
+{
+	if (!initialized || t <= t_prev)
+	{
+		// first sample, or a repeated timestamp: nothing to differentiate against.
+		if (!initialized) { x_prev = x; dx_prev = 0; initialized = true; }
+		t_prev = t;
+		return x_prev;
+	}
+
+	const float dt = (float)(t - t_prev);
+	const float a_d = smoothing_factor(d_cutoff, dt);
+	const float dx = a_d * ((x - x_prev) / dt) + (1 - a_d) * dx_prev;
+
+	const float cutoff = min_cutoff + beta * std::fabs(dx);
+	const float a = smoothing_factor(cutoff, dt);
+	x_prev = a * x + (1 - a) * x_prev;
+	dx_prev = dx;
+	t_prev = t;
+	return x_prev;
+}
+
+kalman_cv_filter::kalman_cv_filter(float process_noise, float measurement_noise)
+	: q(process_noise), r(measurement_noise), pos(0), vel(0), p00(0), p01(0), p11(0), t_prev(0), initialized(false)
+{
+}
+
+void kalman_cv_filter::set_params(float process_noise, float measurement_noise)
+{
+	if (process_noise > 0) q = process_noise;
+	if (measurement_noise > 0) r = measurement_noise;
+}
+
+float kalman_cv_filter::filter(float x, double t)
+{
+	if (!initialized)
+	{
+		pos = x;
+		vel = 0;
+		p00 = r;
+		p01 = 0;
+		p11 = 1e4f; // velocity is unknown until the second sample
+		t_prev = t;
+		initialized = true;
+		return pos;
+	}
+
+	// predict: x = F x, P = F P F' + Q for F = [1 dt; 0 1] and white-noise acceleration
+	const float dt = (float)(t - t_prev);
+	if (dt > 0)
+	{
+		pos += vel * dt;
+		const float dt2 = dt * dt, dt3 = dt2 * dt;
+		p00 += dt * (2 * p01 + dt * p11) + q * dt3 / 3;
+		p01 += dt * p11 + q * dt2 / 2;
+		p11 += q * dt;
+		t_prev = t;
+	}
+
+	// update with the position measurement, H = [1 0]
+	const float s = p00 + r;
+	const float k0 = p00 / s, k1 = p01 / s;
+	const float innovation = x - pos;
+	pos += k0 * innovation;
+	vel += k1 * innovation;
+	p11 -= k1 * p01;
+	p01 -= k0 * p01;
+	p00 -= k0 * p00;
+	return pos;
+}
+
+void pointer_filter::set_mode(int m, float a, float b)
+{
+	if (m != mode) reset();
+	mode = m;
+	for (int i = 0; i < CHANNELS; ++i)
+	{
+		if (mode == POINTER_FILTER_ONE_EURO) euro[i].set_params(a, b);
+		else if (mode == POINTER_FILTER_KALMAN) kalman[i].set_params(a, b);
+	}
+}
+
+void pointer_filter::reset()
+{
+	for (int i = 0; i < CHANNELS; ++i)
+	{
+		euro[i].reset();
+		kalman[i].reset();
+	}
+}
+
+void pointer_filter::apply(float values[CHANNELS], double t, double lookahead)
+{
+	// metric channels are filtered in millimeters so one set of parameters suits both pixels and meters.
+	static const float unit[CHANNELS] = { 1, 1, 1000, 1000, 1000 };
+	for (int i = 0; i < CHANNELS; ++i)
+	{
+		const float v = values[i] * unit[i];
+		if (mode == POINTER_FILTER_ONE_EURO)
+			values[i] = (euro[i].filter(v, t) + euro[i].velocity() * (float)lookahead) / unit[i];
+		else if (mode == POINTER_FILTER_KALMAN)
+			values[i] = (kalman[i].filter(v, t) + kalman[i].velocity() * (float)lookahead) / unit[i];
+	}
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+// Smoothing and latency compensation for the pointer. Every filter works on one coordinate at a time,
+// takes timestamps in seconds, and keeps a velocity estimate so the output can be predicted forward.
+
+enum pointer_filter_mode
+{
+	POINTER_FILTER_NONE = 0,
+	POINTER_FILTER_ONE_EURO = 1,
+	POINTER_FILTER_KALMAN = 2
+};
+
+// One Euro filter (Casiez et al. 2012): a low-pass filter whose cutoff rises with speed, so the pointer
+// is steady when the hand is still and still follows fast motion without lag.
+class one_euro_filter
+{
+	float min_cutoff, beta, d_cutoff;
+	float x_prev, dx_prev;
+	double t_prev;
+	bool initialized;
+public:
+	one_euro_filter(float min_cutoff = 1.0f, float beta = 0.05f, float d_cutoff = 1.0f);
+	void set_params(float min_cutoff, float beta);
+	void reset() { initialized = false; }
+	float filter(float x, double t);
+	float velocity() const { return dx_prev; }
+};
+
+// Constant-velocity Kalman filter with state (position, velocity). process_noise is the spectral density of
+// the unmodelled acceleration, measurement_noise the variance of a single observation.
+class kalman_cv_filter
+{
+	float q, r;
+	float pos, vel;
+	float p00, p01, p11;
+	double t_prev;
+	bool initialized;
+public:
+	kalman_cv_filter(float process_noise = 500.0f, float measurement_noise = 4.0f);
+	void set_params(float process_noise, float measurement_noise);
+	void reset() { initialized = false; }
+	float filter(float x, double t);
+	float velocity() const { return vel; }
+};
+
+// Filters the pointer's pixel (x, y) and metric (x, y, z) coordinates together. Parameters are in pixels
+// and millimeters, which move at similar rates for a hand in range.
+class pointer_filter
+{
+public:
+	static const int CHANNELS = 5;
+private:
+	int mode;
+	one_euro_filter euro[CHANNELS];
+	kalman_cv_filter kalman[CHANNELS];
+public:
+	pointer_filter() : mode(POINTER_FILTER_ONE_EURO) {}
+
+	// For One Euro a is the minimum cutoff in Hz and b the speed coefficient; for Kalman a is the process noise
+	// and b the measurement noise. Values <= 0 keep the current setting, except the One Euro speed coefficient:
+	// 0 turns speed adaptation off there, and only negative values keep it.
+	void set_mode(int mode, float a, float b);
+	int get_mode() const { return mode; }
+	void reset();
+
+	// Filters values observed at time t (seconds) in place, then extrapolates them lookahead seconds forward.
+	void apply(float values[CHANNELS], double t, double lookahead);
+};
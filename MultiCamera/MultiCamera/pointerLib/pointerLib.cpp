@@ -3,6 +3,9 @@
 
 #include <librealsense/rs.hpp>
 #include "example.hpp"
+#include "temporal_filter.hpp"
+#include "decimation.hpp"
+#include "background_model.hpp"
 #include <chrono>
 #include <vector>
 #include <sstream>
@@ -10,42 +13,227 @@
 #include <algorithm>
 #include "pointerLib.h"
 #include "pointerLib.h"
+#include "pointerFilter.h"
+#include "gestureEngine.h"
+#include "pointerEvents.h"
+#include "pointerShared.h"
+#include "handGeometry.h"
+#include "frameArena.h"
+#include "motion_gate.hpp"
+#include "device_manager.hpp"
+#include "depth_range.hpp"
+#include "trace.hpp"
+#include <atomic>
+#include <cassert>
+#include <mutex>
+#include <thread>
 
 static rs::context ctx;
 static state app_state;
 static int frames = 0; 
 static float nexttime = 0, fps = 0;
+static float segmentTime = 0; // ms spent on segmentation and the blob search, smoothed
 
 static std::chrono::steady_clock::time_point t0;
+
+static pointer_filter pointerFilter;
+static double captureOffset = 0; // host ms - device timestamp ms at arrival, smallest seen since the last restart
+static bool hasCaptureOffset = false;
+static double frameArrival = 0;  // host ms the current frame came out of the device
+static float outputLatency = 0;  // ms from a result to the user seeing it, added to the prediction
+static gesture_engine gestureEngine;
+static double lastCaptured = 0; // host ms the last filtered frame was captured at
+
+static double hostMilliseconds()
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static pointer_event_queue eventQueue;
+static std::thread captureThread;
+static std::atomic<bool> capturing(false);
+
+static pointer_frame_hook frameHook = 0;
+static void *frameHookUser = 0;
+
+static pointer_publisher publisher;
+static int serveDecimation = 0;
+static std::vector<uint16_t> servedDepth;
+static rs::intrinsics servedIntrin;
+
+static hand_geometry handGeometry;
+static hand_record lastHand;
+static std::mutex handMutex;
+
+// per-frame buffers of the detection path; reset at the start of every pointerNextFrame.
+static frame_arena frameArena;
+static arena_mat_allocator arenaAllocator(frameArena);
+static int steadyFrames = 0; // frames since the arena last had to grow
+
+// frames of a still scene reuse the last result instead of running the detection.
+static motion_gate motionGate;
+static float motionThreshold = 0.0005f; // meters; 0 runs the detection on every frame
+static int motionRefresh = 30;
+static cv::Point lastPoint(0, 0);
+static int lastZ = 0;
+
+// stream mode follows the measured processing time; drops to a cheap mode after a while without a hand.
+// The device manager restarts the camera if it stalls or drops off USB.
+static device_manager devices;
+static float latencyBudget = 12; // ms; 0 keeps the stream mode
+static const int IDLE_FRAMES = 120;
+static int framesWithoutHand = 0;
+static int lastTimestamp = 0;
+
+// thresholds in meters, converted to the device's raw units every frame, so they hold whatever its depth scale.
+static const float BACKGROUND_MARGIN_M = 0.03f; // nearest a foreground pixel is to the background
+static const float TEMPORAL_DELTA_M = 0.02f;    // largest frame-to-frame step still smoothed
+static depth_range workingRange;
+static bool rangeLimited = false;
+
+// products clients asked for; the streams follow it, so color costs nothing until something needs it.
+static std::atomic<int> subscribed(POINTER_PRODUCT_HAND | POINTER_PRODUCT_DEPTH_PREVIEW);
+static cv::Mat colorPreview;
+
+// registered color and the frame hook get rgb8; the preview only needs yuyv, half the bandwidth.
+static rs::format colorFormatFor(int products)
+{
+	if (products & POINTER_PRODUCT_REGISTERED_COLOR) return rs::format::rgb8;
+	if (products & POINTER_PRODUCT_COLOR_PREVIEW) return rs::format::yuyv;
+	return rs::format::any;
+}
+
+// what one frame of the detection path takes from the arena: the foreground mask and the blob fill stack.
+static size_t frameArenaBytes(int width, int height)
+{
+	const size_t pixels = (size_t)width * height;
+	return pixels * (sizeof(uchar) + sizeof(int)) + 8 * frame_arena::ALIGNMENT;
+}
+
+// 4-connected scanline fill of the pixels equal to the seed's value, like cv::floodFill without a mask but
+// without its per-call allocations. stack needs room for one entry per pixel of mask. Returns the number of
+// pixels filled and their bounding box.
+static int fillBlob(cv::Mat &mask, cv::Point seed, uchar value, int *stack, cv::Rect &bounds)
+{
+	const int w = mask.cols, h = mask.rows;
+	const uchar target = mask.at<uchar>(seed);
+	bounds = cv::Rect(seed.x, seed.y, 1, 1);
+	if (target == value) return 0;
+
+	// every pixel is filled when it is pushed, so the stack never holds more than one entry per pixel.
+	int top = 0, count = 1, x0 = seed.x, x1 = seed.x, y0 = seed.y, y1 = seed.y;
+	mask.at<uchar>(seed) = value;
+	stack[top++] = seed.y * w + seed.x;
+	while (top)
+	{
+		const int p = stack[--top], y = p / w;
+		uchar *row = mask.ptr(y);
+		int left = p % w, right = left;
+		while (left > 0 && row[left - 1] == target) row[--left] = value;
+		while (right < w - 1 && row[right + 1] == target) row[++right] = value;
+		count += right - left;
+		x0 = std::min(x0, left);
+		x1 = std::max(x1, right);
+		y0 = std::min(y0, y);
+		y1 = std::max(y1, y);
+
+		// seed every run of target pixels touching this span in the rows above and below.
+		for (int ny = y - 1; ny <= y + 1; ny += 2)
+		{
+			if (ny < 0 || ny >= h) continue;
+			uchar *next = mask.ptr(ny);
+			bool inRun = false;
+			for (int x = left; x <= right; ++x)
+			{
+				if (next[x] != target) inRun = false;
+				else if (!inRun)
+				{
+					inRun = true;
+					next[x] = value;
+					stack[top++] = ny * w + x;
+					++count;
+				}
+			}
+		}
+	}
+	bounds = cv::Rect(x0, y0, x1 - x0 + 1, y1 - y0 + 1);
+	return count;
+}
  
 extern "C" __declspec(dllexport)
 state *initializePointerLib()
 {
-	if (ctx.get_device_count() > 0)
+	// start at 320x240, 60 fps, or the nearest mode the device has, and let the controller move from there.
+	if (!devices.get_device_count())
 	{
-		static rs::device & dev = *ctx.get_device(0);
-
-		int inputWidth = 320, inputHeight = 240, frameRate = 60;
-		dev.enable_stream(rs::stream::color, inputWidth, inputHeight, rs::format::rgb8, frameRate);
-		dev.enable_stream(rs::stream::depth, inputWidth, inputHeight, rs::format::z16, frameRate);
-		dev.start();
+		devices.open(ctx, colorFormatFor(subscribed), [](int, stream_controller & controller)
+		{
+			const stream_profile idle = { 320, 240, 0, 30 }, active = { 0, 0, 30, 0 };
+			controller.set_profiles(idle, active);
+			controller.set_budget(latencyBudget);
+		}, 1, 320, 240, 60);
+	}
+	if (devices.get_device_count() > 0 && devices.is_streaming(0))
+	{
+		rs::device & dev = *devices.get_device(0);
+		const int inputWidth = dev.get_stream_width(rs::stream::depth), inputHeight = dev.get_stream_height(rs::stream::depth);
 
 		// some placeholders were added for intrinsics and extrinsics.
 		state initState = { 0, 0, 0, 0, false,{ rs::stream::color, rs::stream::depth, rs::stream::infrared }, dev.get_depth_scale(),
 			dev.get_extrinsics(rs::stream::depth, rs::stream::color), dev.get_stream_intrinsics(rs::stream::depth),
 			dev.get_stream_intrinsics(rs::stream::depth), 0, 0, &dev };
 		app_state = initState;
+		if (!gestureEngine.get_template_count()) gestureEngine.add_default_templates();
+		frameArena.reserve(frameArenaBytes(inputWidth, inputHeight));
+		handGeometry.reserve(inputWidth, inputHeight);
 		auto t0 = std::chrono::high_resolution_clock::now();
 		return &app_state;
 	}
 	return 0;
 }
 
-extern "C"  __declspec(dllexport)
-bool pointerNextFrame(int &xInOut, int &yInOut, int &zInOut)
+static bool nextFrame(int &xInOut, int &yInOut, int &zInOut)
 {
 	rs::device & dev = *app_state.dev;
-	if (dev.is_streaming()) dev.wait_for_frames();
+	stream_controller & streamController = devices.get_controller(0);
+	// HighGUI windows only update on the thread that pumps their messages with waitKey, which the internal capture
+	// thread never does, so the previews are left out while it runs.
+	const int products = capturing ? subscribed & ~(POINTER_PRODUCT_DEPTH_PREVIEW | POINTER_PRODUCT_COLOR_PREVIEW) : (int)subscribed;
+	bool restarted = streamController.set_color_format(dev, colorFormatFor(products));
+	{
+		// keeps waiting while the camera streams; gives up while it is being restarted so callers can carry on.
+		MR_TRACE_SCOPE("wait_for_frames");
+		bool switched;
+		while (!devices.next_frame(0, 100, &switched))
+		{
+			if (!devices.is_streaming(0)) return false;
+		}
+		restarted |= switched;
+	}
+	const auto frameStart = std::chrono::steady_clock::now();
+	frameArrival = hostMilliseconds();
+	// a restarted device starts its timestamps over, so the offset to the host clock has to be found again.
+	if (restarted) hasCaptureOffset = false;
+
+	// frames the device produced since the last one we saw and that never reached us.
+	const int timestamp = dev.get_frame_timestamp(rs::stream::depth);
+	const float frameInterval = 1000.0f / std::max(1, dev.get_stream_framerate(rs::stream::depth));
+	const int missed = restarted || !lastTimestamp ? 0 : std::max(0, (int)((timestamp - lastTimestamp) / frameInterval + 0.5f) - 1);
+	lastTimestamp = timestamp;
+
+	// everything the previous frame took from the arena is released by now.
+	const size_t arenaCapacity = frameArena.get_capacity();
+	frameArena.reset();
+	if (restarted)
+	{
+		const int width = dev.get_stream_width(rs::stream::depth), height = dev.get_stream_height(rs::stream::depth);
+		frameArena.reserve(frameArenaBytes(width, height));
+		handGeometry.reserve(width, height);
+		steadyFrames = 0;
+	}
+	if (frameArena.get_capacity() != arenaCapacity) steadyFrames = 0;
+	const unsigned long long overflowsBefore = frameArena.get_overflow_count();
+	unsigned long long heapBefore = heap_allocation_count();
 
 	auto t1 = std::chrono::high_resolution_clock::now();
 	nexttime += std::chrono::duration<float>(t1 - t0).count();
@@ -58,7 +246,9 @@ bool pointerNextFrame(int &xInOut, int &yInOut, int &zInOut)
 		nexttime = 0;
 	}
 
-	const rs::stream tex_stream = app_state.tex_streams[app_state.index];
+	// with color off, the texture falls back to depth itself.
+	const bool hasColor = dev.is_stream_enabled(rs::stream::color);
+	const rs::stream tex_stream = dev.is_stream_enabled(app_state.tex_streams[app_state.index]) ? app_state.tex_streams[app_state.index] : rs::stream::depth;
 	app_state.depth_scale = dev.get_depth_scale();
 	app_state.extrin = dev.get_extrinsics(rs::stream::depth, tex_stream);
 	app_state.depth_intrin = dev.get_stream_intrinsics(rs::stream::depth);
@@ -67,43 +257,398 @@ bool pointerNextFrame(int &xInOut, int &yInOut, int &zInOut)
 
 	// setup the OpenCV Mat structures
 	cv::Mat depth16(app_state.depth_intrin.height, app_state.depth_intrin.width, CV_16U, (uchar *)dev.get_frame_data(rs::stream::depth));
+
+	// keep a decimated copy for shared-memory clients before the frame is filtered in place.
+	if (publisher.has_depth())
+	{
+		servedIntrin = decimate_intrinsics(app_state.depth_intrin, serveDecimation);
+		servedDepth.resize(servedIntrin.width * servedIntrin.height);
+		decimate_depth((uint16_t *)depth16.data, depth16.cols, depth16.rows, serveDecimation, bin_mode::min_nonzero, servedDepth.data());
+	}
 	
-	rs::intrinsics color_intrin = dev.get_stream_intrinsics(rs::stream::color);
-	cv::Mat rgb(color_intrin.height, color_intrin.width, CV_8UC3, (uchar *)dev.get_frame_data(rs::stream::color));
+	cv::Mat color;
+	if (hasColor)
+	{
+		const rs::format colorFormat = dev.get_stream_format(rs::stream::color);
+		color = cv::Mat(dev.get_stream_height(rs::stream::color), dev.get_stream_width(rs::stream::color), colorFormat == rs::format::yuyv ? CV_8UC2 : CV_8UC3,
+			(uchar *)dev.get_frame_data(rs::stream::color));
+	}
+	if (frameHook)
+	{
+		// the hook is the client's code, so its allocations don't count against the frame.
+		const unsigned long long hookBefore = heap_allocation_count();
+		const bool rgb = hasColor && color.type() == CV_8UC3;
+		frameHook((const uint16_t *)depth16.data, depth16.cols, depth16.rows, rgb ? color.data : 0, rgb ? color.cols : 0, rgb ? color.rows : 0, frameHookUser);
+		heapBefore += heap_allocation_count() - hookBefore;
+	}
 
-	// ignore depth greater than 800 mm's.
-	depth16.setTo(10000, depth16 > 800);
-	depth16.setTo(10000, depth16 == 0);
-	cv::Mat depth8u = depth16 < 800;
+	motionGate.configure(app_state.depth_scale, motionThreshold, motionRefresh);
+	if (!motionGate.should_process((const uint16_t *)depth16.data, depth16.cols, depth16.rows))
+	{
+		xInOut = lastPoint.x;
+		yInOut = lastPoint.y;
+		zInOut = lastZ;
+		return lastPoint != cv::Point(0, 0);
+	}
+
+	// smooth out single-frame holes and spikes first, otherwise they flip the foreground test and the mask flickers.
+	static temporal_filter depthFilter;
+	{
+		MR_TRACE_SCOPE("temporal_filter");
+		depthFilter.set_delta(meters_to_raw(TEMPORAL_DELTA_M, app_state.depth_scale));
+		depthFilter.process((uint16_t *)depth16.data, depth16.cols, depth16.rows);
+	}
+	if (rangeLimited)
+	{
+		workingRange.configure(app_state.depth_scale);
+		workingRange.clip((uint16_t *)depth16.data, depth16.total());
+	}
+
+	// foreground is whatever is significantly in front of the learned background, at any distance.
+	const auto segmentStart = std::chrono::steady_clock::now();
+	static background_model background;
+	background.set_min_margin(meters_to_raw(BACKGROUND_MARGIN_M, app_state.depth_scale));
+	cv::Mat depth8u;
+	depth8u.allocator = &arenaAllocator;
+	depth8u.create(depth16.rows, depth16.cols, CV_8U);
+	int foreground;
+	{
+		MR_TRACE_SCOPE("background_model");
+		foreground = background.process((const uint16_t *)depth16.data, depth16.cols, depth16.rows, depth8u.data);
+	}
 
 	cv::Point handPoint(0, 0);
-	for (int y = 0; y < depth8u.rows; ++y)
+	hand_record hand = hand_record();
+	int *fillStack = frameArena.allocate<int>(depth8u.total());
+	if ((products & POINTER_PRODUCT_HAND) && foreground > 100)
 	{
-		uchar *d = depth8u.row(y).ptr();
-		for (int x = 0; x < depth8u.cols; ++x)
+		MR_TRACE_SCOPE("hand search");
+		for (int y = 0; y < depth8u.rows; ++y)
 		{
-			if (d[x])
+			uchar *d = depth8u.ptr(y);
+			for (int x = 0; x < depth8u.cols; ++x)
 			{
-				int floodCount = cv::floodFill(depth8u, cv::Point(x, y), 255);
-				// we have found the top most point
-				if (floodCount > 100)
+				if (d[x] == 255)
 				{
-					handPoint = cv::Point(x, y);
-					break;
+					// visited blobs are filled with 64 so each one is flooded only once.
+					cv::Rect blob;
+					int floodCount = fillBlob(depth8u, cv::Point(x, y), 64, fillStack, blob);
+					if (floodCount > 100)
+					{
+						// mark the hand apart from the other visited blobs and measure it within its bounding box only.
+						fillBlob(depth8u, cv::Point(x, y), 192, fillStack, blob);
+						handGeometry.process(depth8u.data, (int)depth8u.step, depth8u.cols, depth8u.rows, blob.x, blob.y, blob.width, blob.height, 192,
+							(const uint16_t *)depth16.data, app_state.depth_intrin, app_state.depth_scale, hand);
+						// point with the top-most fingertip; a fist has none, so fall back to the palm and then to the
+						// top-most pixel of the blob.
+						if (hand.pointer_tip >= 0) handPoint = cv::Point((int)hand.tip_px[hand.pointer_tip], (int)hand.tip_py[hand.pointer_tip]);
+						else if (hand.valid) handPoint = cv::Point((int)hand.palm_px, (int)hand.palm_py);
+						else handPoint = cv::Point(x, y);
+						break;
+					}
 				}
 			}
+			if (handPoint != cv::Point(0, 0)) break;
 		}
-		if (handPoint != cv::Point(0, 0)) break;
 	}
+	{
+		std::lock_guard<std::mutex> lock(handMutex);
+		lastHand = hand;
+	}
+
+	const float segmentMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - segmentStart).count();
+	segmentTime = segmentTime ? segmentTime * 0.95f + segmentMs * 0.05f : segmentMs;
+
+	// once warm, the detection path above must not touch the heap; the debug windows below are exempt.
+	if (steadyFrames < 30) ++steadyFrames;
+	else assert(heap_allocation_count() == heapBefore && frameArena.get_overflow_count() == overflowsBefore);
 
-	if (handPoint != cv::Point(0, 0))
-		cv::circle(depth8u, handPoint, 10, 128, cv::FILLED);
-	imshow("depth8u", depth8u);
-	cv::cvtColor(rgb, rgb, cv::COLOR_BGR2RGB);
-	imshow("rgb", rgb);
+	MR_TRACE_SCOPE("display");
+	if (products & POINTER_PRODUCT_DEPTH_PREVIEW)
+	{
+		if (hand.valid)
+			cv::circle(depth8u, cv::Point((int)hand.palm_px, (int)hand.palm_py), (int)hand.palm_radius, 128, 2);
+		if (handPoint != cv::Point(0, 0))
+			cv::circle(depth8u, handPoint, 10, 128, cv::FILLED);
+		imshow("depth8u", depth8u);
+	}
+	if ((products & POINTER_PRODUCT_COLOR_PREVIEW) && hasColor)
+	{
+		cv::cvtColor(color, colorPreview, color.type() == CV_8UC2 ? cv::COLOR_YUV2BGR_YUYV : cv::COLOR_RGB2BGR);
+		imshow("rgb", colorPreview);
+	}
 	xInOut = handPoint.x;
 	yInOut = handPoint.y;
-	zInOut = 0; // not using this yet.
+	zInOut = handPoint == cv::Point(0, 0) ? 0 : depth16.at<uint16_t>(handPoint); // raw depth units
+	lastPoint = handPoint;
+	lastZ = zInOut;
+
+	framesWithoutHand = handPoint == cv::Point(0, 0) ? framesWithoutHand + 1 : 0;
+	streamController.set_active(framesWithoutHand < IDLE_FRAMES);
+	streamController.report(std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count(), missed);
 	if (handPoint == cv::Point(0, 0)) return false;
 	return true;
-}
\ No newline at end of file
+}
+
+// any device call can throw once the camera drops off USB; the device manager then restarts it, and until it is
+// back the caller just gets no hand.
+extern "C"  __declspec(dllexport)
+bool pointerNextFrame(int &xInOut, int &yInOut, int &zInOut)
+{
+	MR_TRACE_SCOPE("pointerNextFrame");
+	try
+	{
+		return nextFrame(xInOut, yInOut, zInOut);
+	}
+	catch (const rs::error &)
+	{
+		devices.report_error(0);
+		return false;
+	}
+}
+
+extern "C"  __declspec(dllexport)
+bool pointerNextFrameFiltered(pointer_result *result)
+{
+	MR_TRACE_SCOPE("pointerNextFrameFiltered");
+	int x, y, z;
+	bool found = pointerNextFrame(x, y, z);
+
+	// map the frame timestamp onto the host clock: the smallest delay from capture to arrival seen so far is
+	// taken as the transport time, creeping up slowly to follow clock drift. Both ends are taken when the frame
+	// arrives, so the processing time stays out of it. A camera being restarted has no frame.
+	if (!devices.is_streaming(0))
+	{
+		result->valid = false;
+		pointerFilter.reset();
+		gestureEngine.lose_hand(0);
+		return false;
+	}
+	const int timestamp = lastTimestamp;
+	captureOffset = hasCaptureOffset ? std::min(captureOffset + 0.01, frameArrival - timestamp) : frameArrival - timestamp;
+	hasCaptureOffset = true;
+	const double captured = timestamp + captureOffset;
+	lastCaptured = captured;
+
+	result->timestamp = timestamp;
+	result->valid = found;
+	if (!found)
+	{
+		pointerFilter.reset();
+		gestureEngine.lose_hand(0);
+		return false;
+	}
+
+	rs::float3 point = app_state.depth_intrin.deproject({ (float)x, (float)y }, z * app_state.depth_scale);
+	float values[pointer_filter::CHANNELS] = { (float)x, (float)y, point.x, point.y, point.z };
+	// predict across the time from the frame's arrival to this result, plus what the client said its display adds.
+	const double latency = hostMilliseconds() - frameArrival + outputLatency;
+	pointerFilter.apply(values, captured / 1000, latency / 1000);
+
+	result->px = values[0];
+	result->py = values[1];
+	result->x = values[2];
+	result->y = values[3];
+	result->z = values[4];
+	result->latency_ms = (float)latency;
+	gestureEngine.add_sample(0, values[2], values[3], values[4], captured / 1000);
+	return true;
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetFilter(int mode, float a, float b)
+{
+	pointerFilter.set_mode(mode, a, b);
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetOutputLatency(float latencyMs)
+{
+	outputLatency = std::max(0.0f, latencyMs);
+}
+
+extern "C"  __declspec(dllexport)
+int pointerPollGestures(gesture_event *events, int max)
+{
+	// the capture thread owns the engine while it runs and hands gestures out as events.
+	if (capturing) return -1;
+	return gestureEngine.poll(events, max);
+}
+
+// runs the pointer on its own thread and turns each frame into events.
+static void captureLoop()
+{
+	MR_TRACE_THREAD("pointer capture");
+	pointer_result result;
+	gesture_event gestures[8];
+	while (capturing.load(std::memory_order_relaxed))
+	{
+		const bool found = pointerNextFrameFiltered(&result);
+		const float values[5] = { result.px, result.py, result.x, result.y, result.z };
+
+		// a hand that left may complete a gesture, which belongs before its leave event.
+		if (found) eventQueue.update(true, values, lastCaptured);
+		for (int n; (n = gestureEngine.poll(gestures, 8)) > 0;)
+		{
+			for (int i = 0; i < n; ++i) eventQueue.gesture(gestures[i]);
+		}
+		if (!found) eventQueue.update(false, values, lastCaptured);
+
+		if (publisher.is_open())
+		{
+			const pointer_shared_result shared = { 0, lastCaptured, result.timestamp, found, result.px, result.py, result.x, result.y, result.z, result.latency_ms };
+			const uint64_t frame = publisher.publish(shared);
+			if (publisher.has_depth()) publisher.publish_depth(servedDepth.data(), servedIntrin.width, servedIntrin.height, frame, lastCaptured);
+		}
+	}
+	eventQueue.reset();
+}
+
+extern "C"  __declspec(dllexport)
+bool pointerStart()
+{
+	if (!app_state.dev || capturing) return false;
+	capturing = true;
+	captureThread = std::thread(captureLoop);
+	return true;
+}
+
+extern "C"  __declspec(dllexport)
+void pointerStop()
+{
+	if (!capturing) return;
+	capturing = false;
+	captureThread.join();
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetCallback(pointer_event_callback callback, void *user)
+{
+	eventQueue.set_callback(callback, user);
+}
+
+extern "C"  __declspec(dllexport)
+int pointerDrainEvents(pointer_event *events, int max)
+{
+	return eventQueue.drain(events, max);
+}
+
+extern "C"  __declspec(dllexport)
+bool pointerWaitEvents(int timeoutMs)
+{
+	return eventQueue.wait(timeoutMs);
+}
+
+extern "C"  __declspec(dllexport)
+bool pointerServe(const char *name, int depthDecimation)
+{
+	if (!app_state.dev || capturing) return false;
+
+	int width = 0, height = 0;
+	rs::intrinsics intrin = app_state.depth_intrin;
+	serveDecimation = std::max(0, std::min(depthDecimation, MAX_DECIMATION));
+	if (serveDecimation)
+	{
+		intrin = decimate_intrinsics(app_state.depth_intrin, serveDecimation);
+		width = intrin.width;
+		height = intrin.height;
+	}
+	if (!publisher.open(name, width, height, app_state.depth_scale, intrin.fx, intrin.fy, intrin.ppx, intrin.ppy)) return false;
+	// the published depth frame keeps the size it was opened with, so the stream mode must stay put.
+	if (serveDecimation)
+	{
+		latencyBudget = 0;
+		devices.get_controller(0).set_budget(0);
+	}
+	return pointerStart();
+}
+
+extern "C"  __declspec(dllexport)
+void pointerStopServing()
+{
+	pointerStop();
+	publisher.close();
+}
+
+extern "C"  __declspec(dllexport)
+pointer_subscriber *pointerConnect(const char *name)
+{
+	pointer_subscriber *client = new pointer_subscriber;
+	if (client->open(name)) return client;
+	delete client;
+	return 0;
+}
+
+extern "C"  __declspec(dllexport)
+int pointerReadResults(pointer_subscriber *client, pointer_shared_result *results, int max)
+{
+	return client->read(results, max);
+}
+
+extern "C"  __declspec(dllexport)
+int pointerReadDepth(pointer_subscriber *client, uint16_t *depth, int capacity, int *width, int *height)
+{
+	uint64_t frame;
+	return client->read_depth(depth, capacity, *width, *height, frame);
+}
+
+extern "C"  __declspec(dllexport)
+void pointerDisconnect(pointer_subscriber *client)
+{
+	delete client;
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetFrameHook(pointer_frame_hook hook, void *user)
+{
+	frameHook = hook;
+	frameHookUser = user;
+}
+
+extern "C"  __declspec(dllexport)
+void pointerGetTiming(float *fpsOut, float *segmentMsOut)
+{
+	*fpsOut = fps;
+	*segmentMsOut = segmentTime;
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetMotionGate(float thresholdMeters, int refreshFrames)
+{
+	motionThreshold = std::max(0.0f, thresholdMeters);
+	motionRefresh = std::max(1, refreshFrames);
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSubscribe(int products)
+{
+	subscribed = products;
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetLatencyBudget(float budgetMs)
+{
+	latencyBudget = std::max(0.0f, budgetMs);
+	if (devices.get_device_count()) devices.get_controller(0).set_budget(latencyBudget);
+}
+
+extern "C"  __declspec(dllexport)
+void pointerSetDepthRange(float nearMeters, float farMeters)
+{
+	rangeLimited = farMeters > 0;
+	workingRange.set_meters(std::max(0.0f, nearMeters), farMeters);
+}
+
+extern "C"  __declspec(dllexport)
+bool pointerGetHand(hand_record *hand)
+{
+	std::lock_guard<std::mutex> lock(handMutex);
+	*hand = lastHand;
+	return lastHand.valid != 0;
+}
+
+extern "C"  __declspec(dllexport)
+bool pointerDumpTrace(const char *path)
+{
+	return MR_TRACE_DUMP(path);
+}
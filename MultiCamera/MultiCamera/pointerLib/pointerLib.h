@@ -5,6 +5,10 @@
 #include <librealsense/rs.hpp>
 #include <vector>
 #include <opencv2\opencv.hpp>
+#include "gestureEngine.h"
+#include "pointerEvents.h"
+#include "pointerShared.h"
+#include "handGeometry.h"
 struct state {
 	double yaw, pitch, lastX, lastY;
 	bool ml;
@@ -18,6 +22,96 @@ struct state {
 	rs::device * dev;
 };
 
+// filtered pointer position, in depth image pixels and in meters relative to the depth camera.
+// both are predicted forward by the measured time from the frame's arrival to the result, plus the output
+// latency set with pointerSetOutputLatency.
+struct pointer_result {
+	float px, py;
+	float x, y, z;
+	int timestamp;     // depth frame timestamp (ms) the result was computed from
+	float latency_ms;  // latency the result was predicted across: arrival to result plus the output latency
+	int valid;
+};
+
+// what the library produces; only the streams these need are enabled.
+enum pointer_product
+{
+	POINTER_PRODUCT_HAND = 1,              // the pointer and hand results; depth only
+	POINTER_PRODUCT_DEPTH_PREVIEW = 2,     // the "depth8u" debug window
+	POINTER_PRODUCT_COLOR_PREVIEW = 4,     // the "rgb" debug window; color in yuyv
+	POINTER_PRODUCT_REGISTERED_COLOR = 8   // rgb8 color for the frame hook and state::tex_intrin/extrin
+};
+
 // use dll for all the camera activity.
 extern "C" __declspec(dllexport) state *initializePointerLib();
 extern "C" __declspec(dllexport) bool pointerNextFrame(int &x, int &y, int &z);
+extern "C" __declspec(dllexport) bool pointerNextFrameFiltered(pointer_result *result);
+// sets the pointer_product bits clients need, by default hand and depth preview; streams are switched on or off
+// before the next frame. Callable from any thread.
+extern "C" __declspec(dllexport) void pointerSubscribe(int products);
+// mode is a pointer_filter_mode; see pointer_filter::set_mode for a and b.
+extern "C" __declspec(dllexport) void pointerSetFilter(int mode, float a, float b);
+// what the client adds after a result is returned, in ms: transport to the display, the display's own lag.
+// Filtered results are predicted this much further ahead; 0 by default.
+extern "C" __declspec(dllexport) void pointerSetOutputLatency(float latencyMs);
+// gestures recognized from the filtered pointer path since the last call; returns how many were copied, or -1
+// while pointerStart runs, when gestures arrive as events instead. Only the newest 64 are kept between calls;
+// older ones are dropped, so a client that never polls costs no memory.
+extern "C" __declspec(dllexport) int pointerPollGestures(gesture_event *events, int max);
+
+// event interface: pointerStart runs the pointer on an internal thread that produces hand enter/move/leave and
+// gesture events. Don't call pointerNextFrame or pointerNextFrameFiltered while it runs. The preview windows
+// (POINTER_PRODUCT_DEPTH_PREVIEW and COLOR_PREVIEW) are not shown meanwhile, as nothing on that thread pumps
+// their messages.
+extern "C" __declspec(dllexport) bool pointerStart();
+extern "C" __declspec(dllexport) void pointerStop();
+// the callback runs on the capture thread and replaces the queue; set it before pointerStart.
+extern "C" __declspec(dllexport) void pointerSetCallback(pointer_event_callback callback, void *user);
+// copies up to max queued events into events; returns how many.
+extern "C" __declspec(dllexport) int pointerDrainEvents(pointer_event *events, int max);
+// sleeps until an event is queued or timeoutMs passes; returns whether one is queued.
+extern "C" __declspec(dllexport) bool pointerWaitEvents(int timeoutMs);
+
+// shared-memory service: the process that owns the camera publishes every result, and with depthDecimation
+// 1 to 4 also the depth frame reduced by that factor, under name. Runs the pointer like pointerStart.
+extern "C" __declspec(dllexport) bool pointerServe(const char *name, int depthDecimation);
+extern "C" __declspec(dllexport) void pointerStopServing();
+// client side, usable from any process without a camera. pointerConnect returns 0 until the service is up.
+extern "C" __declspec(dllexport) pointer_subscriber *pointerConnect(const char *name);
+// copies up to max results published since the last call, oldest first; returns how many.
+extern "C" __declspec(dllexport) int pointerReadResults(pointer_subscriber *client, pointer_shared_result *results, int max);
+// copies the newest depth frame if it wasn't read yet; returns its pixel count, 0 if none (or if it stays mid-write,
+// e.g. because the server died; the next call tries again), -1 if capacity is too small.
+extern "C" __declspec(dllexport) int pointerReadDepth(pointer_subscriber *client, uint16_t *depth, int capacity, int *width, int *height);
+extern "C" __declspec(dllexport) void pointerDisconnect(pointer_subscriber *client);
+
+// called by pointerNextFrame (on the capture thread once started) with every new frame before anything modifies
+// it; depth is z16 and color rgb8, or null with zero size unless POINTER_PRODUCT_REGISTERED_COLOR is subscribed.
+// Set it before pointerStart.
+typedef void (*pointer_frame_hook)(const uint16_t *depth, int depthWidth, int depthHeight, const uint8_t *rgb, int colorWidth, int colorHeight, void *user);
+extern "C" __declspec(dllexport) void pointerSetFrameHook(pointer_frame_hook hook, void *user);
+
+// frame rate of pointerNextFrame and the smoothed time it spends on segmentation and the blob search.
+extern "C" __declspec(dllexport) void pointerGetTiming(float *fps, float *segmentMs);
+
+// frames whose depth differs from the last processed one by less than thresholdMeters on average (after per-pixel
+// noise) repeat its result without running the detection, except every refreshFrames-th. 0 disables the gate.
+// Defaults are 0.0005 and 30; set them before pointerStart.
+extern "C" __declspec(dllexport) void pointerSetMotionGate(float thresholdMeters, int refreshFrames);
+
+// stream mode adapts to keep a frame's processing within budgetMs (default 12): the best mode that fits while a
+// hand is around, at most 320x240 at 30 fps after 120 processed frames without one. 0 keeps the current mode; serving
+// depth with pointerServe and initializing through the JNI bridge do that too.
+extern "C" __declspec(dllexport) void pointerSetLatencyBudget(float budgetMs);
+
+// depth outside nearMeters..farMeters counts as no data, so nothing there is taken for a hand. Converted to the
+// camera's raw units, so it means the same on every device. farMeters of 0 removes the limit (the default); set
+// it before pointerStart.
+extern "C" __declspec(dllexport) void pointerSetDepthRange(float nearMeters, float farMeters);
+
+// palm and fingertips of the hand found in the last frame; returns whether there was one.
+extern "C" __declspec(dllexport) bool pointerGetHand(hand_record *hand);
+
+// writes the spans recorded so far as Chrome trace-event JSON; false if tracing is compiled out (define
+// MR_ENABLE_TRACE) or the file could not be written.
+extern "C" __declspec(dllexport) bool pointerDumpTrace(const char *path);
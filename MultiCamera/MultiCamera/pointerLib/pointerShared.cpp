@@ -0,0 +1,255 @@
+#include "pointerShared.h"
+#include <cstring>
+#include <new>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static size_t align64(size_t n) { return (n + 63) & ~(size_t)63; }
+
+#ifdef _WIN32
+shared_region::shared_region() : base(nullptr), size(0), owner(false), handle(nullptr) {}
+
+bool shared_region::create(const char * n, size_t s)
+{
+	close();
+	name = std::string("Local\\") + n;
+	handle = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, (DWORD)((uint64_t)s >> 32), (DWORD)s, name.c_str());
+	if (!handle) return false;
+	base = MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, s);
+	if (!base) { close(); return false; }
+	size = s;
+	owner = true;
+	return true;
+}
+
+bool shared_region::open(const char * n)
+{
+	close();
+	name = std::string("Local\\") + n;
+	handle = OpenFileMappingA(FILE_MAP_READ, FALSE, name.c_str());
+	if (!handle) return false;
+	base = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+	if (!base) { close(); return false; }
+	MEMORY_BASIC_INFORMATION info;
+	size = VirtualQuery(base, &info, sizeof(info)) ? info.RegionSize : 0;
+	return true;
+}
+
+void shared_region::close()
+{
+	if (base) UnmapViewOfFile(base);
+	if (handle) CloseHandle(handle);
+	base = handle = nullptr;
+	size = 0;
+	owner = false;
+}
+#else
+shared_region::shared_region() : base(nullptr), size(0), owner(false), fd(-1) {}
+
+bool shared_region::create(const char * n, size_t s)
+{
+	close();
+	name = std::string("/") + n;
+	shm_unlink(name.c_str());
+	fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (fd < 0) return false;
+	owner = true;
+	if (ftruncate(fd, (off_t)s) != 0) { close(); return false; }
+	base = mmap(nullptr, s, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) { base = nullptr; close(); return false; }
+	size = s;
+	return true;
+}
+
+bool shared_region::open(const char * n)
+{
+	close();
+	name = std::string("/") + n;
+	fd = shm_open(name.c_str(), O_RDONLY, 0);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) { close(); return false; }
+	base = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED) { base = nullptr; close(); return false; }
+	size = (size_t)st.st_size;
+	return true;
+}
+
+void shared_region::close()
+{
+	if (base) munmap(base, size);
+	if (fd >= 0) ::close(fd);
+	if (owner) shm_unlink(name.c_str());
+	base = nullptr;
+	fd = -1;
+	size = 0;
+	owner = false;
+}
+#endif
+
+bool pointer_publisher::open(const char * name, int depth_width, int depth_height, float depth_scale, float fx, float fy, float ppx, float ppy)
+{
+	close();
+	const bool with_depth = depth_width > 0 && depth_height > 0;
+	const size_t depth_slot_size = with_depth ? align64(sizeof(shared_depth_slot)) + align64((size_t)depth_width * depth_height * 2) : 0;
+	const size_t results_offset = align64(sizeof(shared_header));
+	const size_t depth_offset = results_offset + RESULT_SLOTS * sizeof(shared_result_slot);
+	const size_t size = depth_offset + (with_depth ? DEPTH_SLOTS : 0) * depth_slot_size;
+	if (!region.create(name, size)) return false;
+
+	// fresh mappings are zeroed, so every seqlock starts even and both counts at 0.
+	uint8_t * base = (uint8_t *)region.data();
+	header = new (base) shared_header;
+	results = (shared_result_slot *)(base + results_offset);
+	depth = with_depth ? base + depth_offset : nullptr;
+
+	header->version = shared_header::VERSION;
+	header->result_slots = RESULT_SLOTS;
+	header->depth_slots = with_depth ? DEPTH_SLOTS : 0;
+	header->depth_slot_size = (uint32_t)depth_slot_size;
+	header->depth_width = with_depth ? depth_width : 0;
+	header->depth_height = with_depth ? depth_height : 0;
+	header->depth_scale = depth_scale;
+	header->fx = fx;
+	header->fy = fy;
+	header->ppx = ppx;
+	header->ppy = ppy;
+	header->result_count.store(0, std::memory_order_relaxed);
+	header->depth_count.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	header->magic = shared_header::MAGIC;
+	return true;
+}
+
+void pointer_publisher::close()
+{
+	region.close();
+	header = nullptr;
+	results = nullptr;
+	depth = nullptr;
+}
+
+uint64_t pointer_publisher::publish(const pointer_shared_result & result)
+{
+	const uint64_t i = header->result_count.load(std::memory_order_relaxed);
+	shared_result_slot & slot = results[i % RESULT_SLOTS];
+	const uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+	slot.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.result = result;
+	slot.result.frame = i;
+	slot.seq.store(seq + 2, std::memory_order_release);
+	header->result_count.store(i + 1, std::memory_order_release);
+	return i;
+}
+
+void pointer_publisher::publish_depth(const uint16_t * pixels, int width, int height, uint64_t frame, double captured_ms)
+{
+	if (!depth || width > (int)header->depth_width || height > (int)header->depth_height) return;
+
+	const uint64_t i = header->depth_count.load(std::memory_order_relaxed);
+	shared_depth_slot & slot = *(shared_depth_slot *)(depth + (i % DEPTH_SLOTS) * header->depth_slot_size);
+	const uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+	slot.seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot.width = width;
+	slot.height = height;
+	slot.frame = frame;
+	slot.captured_ms = captured_ms;
+	memcpy((uint8_t *)&slot + align64(sizeof(shared_depth_slot)), pixels, (size_t)width * height * 2);
+	slot.seq.store(seq + 2, std::memory_order_release);
+	header->depth_count.store(i + 1, std::memory_order_release);
+}
+
+bool pointer_subscriber::open(const char * name)
+{
+	close();
+	if (!region.open(name)) return false;
+
+	const uint8_t * base = (const uint8_t *)region.data();
+	const shared_header * h = (const shared_header *)base;
+	if (region.get_size() < sizeof(shared_header) || h->magic != shared_header::MAGIC || h->version != shared_header::VERSION)
+	{
+		region.close();
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+
+	header = h;
+	results = (const shared_result_slot *)(base + align64(sizeof(shared_header)));
+	depth = h->depth_slots ? (const uint8_t *)(results + h->result_slots) : nullptr;
+	cursor = header->result_count.load(std::memory_order_acquire);
+	depth_cursor = header->depth_count.load(std::memory_order_acquire);
+	lost = 0;
+	return true;
+}
+
+void pointer_subscriber::close()
+{
+	region.close();
+	header = nullptr;
+	results = nullptr;
+	depth = nullptr;
+}
+
+int pointer_subscriber::read(pointer_shared_result * out, int max)
+{
+	if (!header) return 0;
+	const uint64_t count = header->result_count.load(std::memory_order_acquire);
+	const uint32_t slots = header->result_slots;
+	if (count - cursor > slots)
+	{
+		lost += count - slots - cursor;
+		cursor = count - slots;
+	}
+
+	int n = 0;
+	for (; cursor < count && n < max; ++cursor)
+	{
+		const shared_result_slot & slot = results[cursor % slots];
+		const uint32_t before = slot.seq.load(std::memory_order_acquire);
+		const pointer_shared_result copy = slot.result;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		const uint32_t after = slot.seq.load(std::memory_order_relaxed);
+
+		// a torn or newer record means the publisher lapped this reader while it copied.
+		if ((before & 1) || before != after || copy.frame != cursor) ++lost;
+		else out[n++] = copy;
+	}
+	return n;
+}
+
+int pointer_subscriber::read_depth(uint16_t * out, int capacity, int & width, int & height, uint64_t & frame)
+{
+	if (!depth) return 0;
+	const uint64_t count = header->depth_count.load(std::memory_order_acquire);
+	if (count == depth_cursor) return 0;
+
+	const shared_depth_slot & slot = *(const shared_depth_slot *)(depth + ((count - 1) % header->depth_slots) * header->depth_slot_size);
+	const uint16_t * pixels = (const uint16_t *)((const uint8_t *)&slot + align64(sizeof(shared_depth_slot)));
+	// bounded, as a publisher that dies mid-write leaves the slot odd for good.
+	for (int attempt = 0; attempt < DEPTH_READ_ATTEMPTS; ++attempt)
+	{
+		const uint32_t before = slot.seq.load(std::memory_order_acquire);
+		if (before & 1) continue;
+		const int w = slot.width, h = slot.height;
+		if (w * h > capacity) return -1;
+		const uint64_t f = slot.frame;
+		memcpy(out, pixels, (size_t)w * h * 2);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot.seq.load(std::memory_order_relaxed) != before) continue;
+
+		width = w;
+		height = h;
+		frame = f;
+		depth_cursor = count;
+		return w * h;
+	}
+	return 0;
+}
@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Publishes the pointer into a named shared-memory region so any number of local processes can read the stream
+// of one camera. The producer never waits for readers: every slot is guarded by a seqlock (odd while being
+// written) and a reader that falls a whole ring behind just loses the oldest entries. Readers map the region
+// read-only and need no system calls once it is mapped.
+//
+// Layout: shared_header, then result_slots shared_result_slot records, then depth_slots depth slots of
+// depth_slot_size bytes each (a shared_depth_slot followed by the pixels). Every part is 64-byte aligned.
+
+struct pointer_shared_result
+{
+	uint64_t frame;        // index of the result in the stream
+	double captured_ms;    // host capture time in ms
+	int32_t timestamp;     // device timestamp in ms
+	int32_t valid;         // whether a hand was found; the coordinates are only meaningful if so
+	float px, py;          // filtered pointer in depth image pixels
+	float x, y, z;         // the same in meters
+	float latency_ms;
+};
+
+struct shared_header
+{
+	static const uint32_t MAGIC = 0x5054524d; // "MRTP"
+	static const uint32_t VERSION = 1;
+
+	uint32_t magic;            // written last, once the region is ready
+	uint32_t version;
+	uint32_t result_slots;
+	uint32_t depth_slots;      // 0 when depth is not published
+	uint32_t depth_slot_size;
+	uint32_t depth_width, depth_height;
+	float depth_scale;         // meters per depth unit
+	float fx, fy, ppx, ppy;    // intrinsics of the published depth
+	alignas(64) std::atomic<uint64_t> result_count; // results published so far
+	alignas(64) std::atomic<uint64_t> depth_count;  // depth frames published so far
+};
+
+struct alignas(64) shared_result_slot
+{
+	std::atomic<uint32_t> seq;
+	pointer_shared_result result;
+};
+
+struct alignas(64) shared_depth_slot
+{
+	std::atomic<uint32_t> seq;
+	int32_t width, height;
+	uint64_t frame;        // pointer_shared_result::frame this depth belongs to
+	double captured_ms;
+};
+
+// A named shared-memory mapping; CreateFileMapping on Windows, shm_open elsewhere.
+class shared_region
+{
+	void * base;
+	size_t size;
+	bool owner;
+	std::string name;
+#ifdef _WIN32
+	void * handle;
+#else
+	int fd;
+#endif
+public:
+	shared_region();
+	~shared_region() { close(); }
+
+	bool create(const char * name, size_t size); // read-write, replaces a stale region of the same name
+	bool open(const char * name);                // read-only
+	void close();
+	void * data() const { return base; }
+	size_t get_size() const { return size; }
+};
+
+class pointer_publisher
+{
+public:
+	static const uint32_t RESULT_SLOTS = 256;
+	static const uint32_t DEPTH_SLOTS = 4;
+private:
+	shared_region region;
+	shared_header * header;
+	shared_result_slot * results;
+	uint8_t * depth;
+public:
+	pointer_publisher() : header(nullptr), results(nullptr), depth(nullptr) {}
+
+	// depth_width/height of 0 publishes results only.
+	bool open(const char * name, int depth_width, int depth_height, float depth_scale, float fx, float fy, float ppx, float ppy);
+	void close();
+	bool is_open() const { return header != nullptr; }
+	bool has_depth() const { return depth != nullptr; }
+
+	// Returns the frame index given to the result.
+	uint64_t publish(const pointer_shared_result & result);
+	void publish_depth(const uint16_t * pixels, int width, int height, uint64_t frame, double captured_ms);
+};
+
+class pointer_subscriber
+{
+public:
+	// attempts read_depth makes at a slot that is being written before giving up until the next call
+	static const int DEPTH_READ_ATTEMPTS = 256;
+private:
+	shared_region region;
+	const shared_header * header;
+	const shared_result_slot * results;
+	const uint8_t * depth;
+	uint64_t cursor, lost, depth_cursor;
+public:
+	pointer_subscriber() : header(nullptr), results(nullptr), depth(nullptr), cursor(0), lost(0), depth_cursor(0) {}
+
+	// Fails until a publisher has created the region; starts reading at the newest result.
+	bool open(const char * name);
+	void close();
+	const shared_header * get_header() const { return header; }
+
+	// Copies up to max results published since the last call, oldest first.
+	int read(pointer_shared_result * out, int max);
+	// Copies the newest depth frame if it has not been read yet; returns its pixel count, 0 if there is none,
+	// or -1 if capacity is too small. A frame still being written after DEPTH_READ_ATTEMPTS tries (e.g. the
+	// publisher died mid-write) also gives 0, and is tried again on the next call.
+	int read_depth(uint16_t * out, int capacity, int & width, int & height, uint64_t & frame);
+	// results overwritten before this reader got to them
+	uint64_t get_lost_count() const { return lost; }
+};
@@ -2,6 +2,7 @@
 #include <pxcsensemanager.h>
 #include <opencv2/core/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "trace.hpp"
 
 enum RequestedFormat {
 	RGB24 = 0,
@@ -91,6 +92,9 @@ void convertPXCImageToOpenCVMat(PXCImage * inImage, cv::Mat& outImg, RequestedFo
 }
 
 int main() {
+	MR_TRACE_THREAD("RawStreams");
+	MR_TRACE_DUMP_AT_EXIT("trace.json");
+
 	PXCSenseManager *senseManager = PXCSenseManager::CreateInstance();
 	if (!senseManager) {
 		std::cout << "Could not create PXCSenseManager\n";
@@ -116,17 +120,28 @@ int main() {
 		return -1;
 	}
 	
-	while (senseManager->AcquireFrame(true) >= PXC_STATUS_NO_ERROR) { 
+	for (;;) {
+		MR_TRACE_SCOPE("frame");
+		{
+			MR_TRACE_SCOPE("AcquireFrame");
+			if (senseManager->AcquireFrame(true) < PXC_STATUS_NO_ERROR) break;
+		}
 		sample = senseManager->QuerySample();
 		colorImage = sample->color;
 		depthImage = sample->depth;
 
-		convertPXCImageToOpenCVMat(colorImage, colorMat, RequestedFormat::RGB24);
-		convertPXCImageToOpenCVMat(depthImage, depthMat, RequestedFormat::DEPTH);
+		{
+			MR_TRACE_SCOPE("convert");
+			convertPXCImageToOpenCVMat(colorImage, colorMat, RequestedFormat::RGB24);
+			convertPXCImageToOpenCVMat(depthImage, depthMat, RequestedFormat::DEPTH);
+		}
 
-		cv::imshow(color_window, colorMat);
-		cv::imshow(depth_window, depthMat);
-		key = cv::waitKey(10);
+		{
+			MR_TRACE_SCOPE("imshow");
+			cv::imshow(color_window, colorMat);
+			cv::imshow(depth_window, depthMat);
+			key = cv::waitKey(10);
+		}
 		if (key == 27) {
 			break;
 		}